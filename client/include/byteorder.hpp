@@ -0,0 +1,148 @@
+#ifndef BYTEORDER_HPP
+#define BYTEORDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTEORDER_X86 1
+#endif
+
+// Bulk host <-> network byte order conversion for array fields.
+// Converting is the same operation in both directions (a byte swap on little
+// endian hosts, a plain copy on big endian ones), so there is one kernel per
+// element width. dst and src may point to the same memory, but must not
+// otherwise overlap.
+namespace byteorder {
+
+namespace detail {
+    inline void Swap32Scalar(char* dst, const char* src, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t v;
+            memcpy(&v, src + i * 4, 4);
+            v = __builtin_bswap32(v);
+            memcpy(dst + i * 4, &v, 4);
+        }
+    }
+
+    inline void Swap64Scalar(char* dst, const char* src, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t v;
+            memcpy(&v, src + i * 8, 8);
+            v = __builtin_bswap64(v);
+            memcpy(dst + i * 8, &v, 8);
+        }
+    }
+
+#ifdef BYTEORDER_X86
+    // Shuffle masks reversing the bytes of every 32/64-bit lane
+    #define BYTEORDER_MASK32 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+    #define BYTEORDER_MASK64 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+    // Returns the number of bytes handled, the caller finishes the tail
+    __attribute__((target("ssse3")))
+    inline size_t SwapSSSE3(char* dst, const char* src, size_t bytes, __m128i mask) {
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t SwapAVX2(char* dst, const char* src, size_t bytes, __m256i mask) {
+        size_t i = 0;
+        for (; i + 64 <= bytes; i += 64) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, mask));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+        }
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, mask));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t Swap32AVX2(char* dst, const char* src, size_t bytes) {
+        return SwapAVX2(dst, src, bytes, _mm256_setr_epi8(BYTEORDER_MASK32, BYTEORDER_MASK32));
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t Swap64AVX2(char* dst, const char* src, size_t bytes) {
+        return SwapAVX2(dst, src, bytes, _mm256_setr_epi8(BYTEORDER_MASK64, BYTEORDER_MASK64));
+    }
+
+    __attribute__((target("ssse3")))
+    inline size_t Swap32SSSE3(char* dst, const char* src, size_t bytes) {
+        return SwapSSSE3(dst, src, bytes, _mm_setr_epi8(BYTEORDER_MASK32));
+    }
+
+    __attribute__((target("ssse3")))
+    inline size_t Swap64SSSE3(char* dst, const char* src, size_t bytes) {
+        return SwapSSSE3(dst, src, bytes, _mm_setr_epi8(BYTEORDER_MASK64));
+    }
+
+    #undef BYTEORDER_MASK32
+    #undef BYTEORDER_MASK64
+
+    // 0 = scalar, 1 = SSSE3, 2 = AVX2; probed once per process
+    inline int SimdLevel() {
+        static const int level = __builtin_cpu_supports("avx2")  ? 2
+                               : __builtin_cpu_supports("ssse3") ? 1
+                               : 0;
+        return level;
+    }
+#endif
+}
+
+inline constexpr bool host_is_network_order = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+inline void Swap32(void* dst, const void* src, size_t count) {
+    char* d = static_cast<char*>(dst);
+    const char* s = static_cast<const char*>(src);
+
+    if constexpr (host_is_network_order) {
+        if (d != s)
+            memcpy(d, s, count * 4);
+        return;
+    }
+
+    size_t done = 0;
+#ifdef BYTEORDER_X86
+    switch (detail::SimdLevel()) {
+        case 2: done = detail::Swap32AVX2(d, s, count * 4); break;
+        case 1: done = detail::Swap32SSSE3(d, s, count * 4); break;
+    }
+#endif
+    detail::Swap32Scalar(d + done, s + done, count - done / 4);
+}
+
+inline void Swap64(void* dst, const void* src, size_t count) {
+    char* d = static_cast<char*>(dst);
+    const char* s = static_cast<const char*>(src);
+
+    if constexpr (host_is_network_order) {
+        if (d != s)
+            memcpy(d, s, count * 8);
+        return;
+    }
+
+    size_t done = 0;
+#ifdef BYTEORDER_X86
+    switch (detail::SimdLevel()) {
+        case 2: done = detail::Swap64AVX2(d, s, count * 8); break;
+        case 1: done = detail::Swap64SSSE3(d, s, count * 8); break;
+    }
+#endif
+    detail::Swap64Scalar(d + done, s + done, count - done / 8);
+}
+
+}
+
+#endif
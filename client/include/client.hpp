@@ -3,9 +3,14 @@
 
 #include <string>
 #include <thread>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <functional>
+#include <netinet/in.h>
 
-// Forward declaration
-class Message;
+#include <datagram.hpp>
 
 class Client
 {
@@ -13,17 +18,112 @@ public:
     Client();
     ~Client();
 
+    // Starts connecting in the background; HandleReceive drives the attempt.
+    // All resolved addresses are tried, a new one every attempt_delay while
+    // earlier ones are still pending, and the first to connect wins. Lost
+    // connections and failed attempts are retried with jittered exponential
+    // backoff until Close(). False if host does not resolve.
     bool Connect(const std::string& host, int port);
     void HandleReceive();
+
+    // Frames are queued while not connected and flushed in order once the
+    // connection is up; unreliable messages are dropped instead
     void Send(Message& message);
+    void FlushDatagrams() { _udp.Flush(); }
+
+    // Drops the connection, reconnecting after a backoff delay
     void Disconnect(const std::string& reason);
 
+    // Drops the connection and stops reconnecting
+    void Close();
+
+    // Called when a blob header arrives with the blob's name and length.
+    // Returns the file descriptor the bytes are spliced into (the client
+    // closes it once the blob is complete) or -1 to discard them.
+    using BlobSink = std::function<int(const std::string& name, int64_t length)>;
+    void SetBlobSink(BlobSink sink) { _blobSink = std::move(sink); }
+
+    // Asks the server for CRC32C frame trailers in both directions on this
+    // and every later connection
+    void SetChecksums(bool enabled);
+
     bool connected() const { return _connected; }
+    bool connecting() const { return !_attempts.empty(); }
+
+    // Requests sent on this connection that have not been answered yet
+    int outstanding() const { return _outstanding; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Attempt {
+        int fd;
+        sockaddr_storage addr;
+        socklen_t length;
+    };
+
+    bool Resolve();
+    void StartAttempt();
+    void PollConnect();
+    void Connected(const Attempt& attempt);
+    void FailConnect(const std::string& reason);
+    void CloseAttempts();
+    void FlushSends();
+
+    void ReceiveDatagrams();
+    void ReceiveFrame();
+    void Dispatch(unsigned char messageId, Decoder& decoder);
+    void OpenDatagrams(uint32_t session);
+    void NegotiateChecksums();
+
+    void ReceiveBlob();
+    void FinishBlob();
 
 private:
     int  _socket;
     bool _connected;
     int  _currentSize;
+    int  _outstanding;
+
+    // pending frame, read over as many ticks as it takes to arrive
+    std::vector<char> _frame;
+    int               _received;
+
+    // connect state: pending attempts race, the rest of the resolved
+    // addresses start one by one; _failures drives the backoff delay
+    std::string                   _host;
+    int                           _port;
+    std::vector<sockaddr_storage> _addresses;
+    size_t                        _nextAddress;
+    std::vector<Attempt>          _attempts;
+    Clock::time_point             _lastAttempt;
+    Clock::time_point             _connectDeadline;
+    Clock::time_point             _retryAt;
+    int                           _failures;
+    std::mt19937                  _random;
+
+    // encoded frames not yet written; _sendOffset bytes of them are sent
+    std::vector<char> _sendQueue;
+    size_t            _sendOffset;
+
+    // CRC32C frame trailers, see SetChecksums
+    bool _wantChecksums;
+    bool _checksums;
+    bool _requireChecksums;
+    bool _currentChecksum;
+
+    // raw bytes still owed by the blob being received
+    BlobSink _blobSink;
+    int64_t  _blobRemaining;
+    int      _blobFd;
+    int      _pipe[2];
+
+    // optional UDP channel for Delivery::Unreliable messages; the
+    // registration datagram is repeated until the server acknowledges it
+    DatagramChannel _udp;
+    sockaddr_in     _serverAddr;
+    uint32_t        _udpSession;
+    bool            _udpConfirmed;
 };
 
 #endif
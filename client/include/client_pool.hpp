@@ -0,0 +1,68 @@
+#ifndef CLIENT_POOL_HPP
+#define CLIENT_POOL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <client.hpp>
+
+// Spreads requests over several server instances.
+//
+// Every node (host:port) holds one or more connections. A request key is hashed
+// onto a consistent-hash ring of virtual nodes, so adding or removing a node
+// only moves the keys that land next to its points. Within the chosen node
+// the connection with the fewest unanswered requests is used. A node is taken
+// off the ring as soon as any of its connections fails; the connections
+// reconnect on their own with backoff and the node rejoins the ring once all
+// of them are up again.
+class ClientPool
+{
+public:
+    // The server handles a single connection at a time; extra connections
+    // complete their handshake in its backlog and look up without ever
+    // being read, so only raise connectionsPerNode for servers that serve
+    // them concurrently
+    explicit ClientPool(int connectionsPerNode = 1, int virtualNodes = 128);
+
+    void AddNode(const std::string& host, int port);
+    void RemoveNode(const std::string& host, int port);
+
+    // Routes the message to the node owning key; false if no node is up
+    bool Send(std::string_view key, Message& message);
+
+    // Ticks every connection and moves nodes on and off the ring
+    void HandleReceive();
+
+    size_t healthyNodes() const;
+
+    // Node that currently owns key, as "host:port", empty if none is up
+    std::string Route(std::string_view key) const;
+
+private:
+    struct Node {
+        std::string host;
+        int port;
+        std::string name;
+        std::vector<std::unique_ptr<Client>> connections;
+        bool healthy;
+    };
+
+    bool ConnectNode(Node& node);
+    void FailNode(Node& node, const std::string& reason);
+    void RebuildRing();
+    const Node* Lookup(std::string_view key) const;
+
+private:
+    int _connectionsPerNode;
+    int _virtualNodes;
+
+    std::vector<std::unique_ptr<Node>> _nodes;
+
+    // sorted (hash, node) points of the healthy nodes
+    std::vector<std::pair<uint64_t, Node*>> _ring;
+};
+
+#endif
@@ -5,6 +5,22 @@ namespace constants {
     constexpr int server_port = 5000;
     constexpr int hello_id = 1;
     constexpr int reply_id = 2;
+    constexpr int blob_id = 3;
+    constexpr int error_id = 4;
+    constexpr int udp_session_id = 5;
+    constexpr int state_id = 6;
+    constexpr int integrity_id = 7;
+
+    // Set in a frame's length prefix when a CRC32C trailer follows the payload
+    constexpr int checksum_flag = 0x40000000;
+
+    // Largest frame either side accepts, length prefix and trailer included
+    constexpr int max_frame_size = 1 << 20;
+
+    // ErrorMessage codes
+    constexpr short error_generic = 0;
+    constexpr short error_rate_limited = 1;
+    constexpr short error_overloaded = 2;
 }
 
 #endif
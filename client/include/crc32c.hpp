@@ -0,0 +1,111 @@
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+// CRC32C (Castagnoli) as used for frame trailers. Uses the SSE4.2 crc32
+// instruction when the CPU has it and slicing-by-8 tables otherwise; both
+// produce the same standard (reflected, inverted) checksum.
+namespace crc32c {
+
+namespace detail {
+    constexpr uint32_t polynomial = 0x82F63B78; // reflected 0x1EDC6F41
+
+    constexpr std::array<std::array<uint32_t, 256>, 8> MakeTables() {
+        std::array<std::array<uint32_t, 256>, 8> tables{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (polynomial & (0u - (crc & 1)));
+            }
+            tables[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xff];
+            }
+        }
+        return tables;
+    }
+
+    inline constexpr auto tables = MakeTables();
+
+    inline uint32_t Software(uint32_t crc, const unsigned char* data, size_t size) {
+        // slicing-by-8 (little endian loads)
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            if constexpr (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) {
+                word = __builtin_bswap64(word);
+            }
+            word ^= crc;
+            crc = tables[7][word & 0xff] ^
+                  tables[6][(word >> 8) & 0xff] ^
+                  tables[5][(word >> 16) & 0xff] ^
+                  tables[4][(word >> 24) & 0xff] ^
+                  tables[3][(word >> 32) & 0xff] ^
+                  tables[2][(word >> 40) & 0xff] ^
+                  tables[1][(word >> 48) & 0xff] ^
+                  tables[0][word >> 56];
+            data += 8;
+            size -= 8;
+        }
+        while (size--) {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xff];
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_X86
+    __attribute__((target("sse4.2")))
+    inline uint32_t Hardware(uint32_t crc, const unsigned char* data, size_t size) {
+        uint64_t crc64 = crc;
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+            data += 8;
+            size -= 8;
+        }
+        crc = static_cast<uint32_t>(crc64);
+        while (size--) {
+            crc = _mm_crc32_u8(crc, *data++);
+        }
+        return crc;
+    }
+
+    inline bool HasHardware() {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#endif
+}
+
+// Checksum of data, pass a previous result as crc to continue it
+inline uint32_t Compute(const void* data, size_t size, uint32_t crc = 0) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (detail::HasHardware()) {
+        return ~detail::Hardware(crc, bytes, size);
+    }
+#endif
+    return ~detail::Software(crc, bytes, size);
+}
+
+// Portable path only, for comparison and benchmarking
+inline uint32_t ComputeSoftware(const void* data, size_t size, uint32_t crc = 0) {
+    return ~detail::Software(~crc, static_cast<const unsigned char*>(data), size);
+}
+
+}
+
+#endif
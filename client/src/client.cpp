@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 #include <client.hpp>
 #include <message.hpp>
 #include <constants.hpp>
@@ -10,71 +11,317 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
 #include <errno.h>
 
+// Happy eyeballs: the next address starts if the last one is silent this long
+static constexpr auto attempt_delay = std::chrono::milliseconds(250);
+
+// A connect that gets nowhere within this is given up and retried later
+static constexpr auto connect_timeout = std::chrono::seconds(3);
+
+// Reconnect delays double per failed attempt within [base, max], jittered
+static constexpr auto backoff_base = std::chrono::milliseconds(100);
+static constexpr auto backoff_max = std::chrono::milliseconds(5000);
+
+// Frames kept while the connection is down before sends are dropped
+static constexpr size_t max_queued_bytes = 1 << 20;
+
 Client::Client()
-: _socket(-1), _connected(false), _currentSize(0)
+: _socket(-1), _connected(false), _currentSize(0), _outstanding(0), _received(0),
+  _port(0), _nextAddress(0), _failures(0), _random(std::random_device{}()),
+  _sendOffset(0),
+  _wantChecksums(false), _checksums(false), _requireChecksums(false), _currentChecksum(false),
+  _blobRemaining(0), _blobFd(-1), _pipe{-1, -1},
+  _serverAddr{}, _udpSession(0), _udpConfirmed(false)
 {}
 
 Client::~Client()
 {
-    if (_connected) {
-        close(_socket);
+    Close();
+    if (_pipe[0] != -1) {
+        close(_pipe[0]);
+        close(_pipe[1]);
     }
 }
 
 bool Client::Connect(const std::string& host, int port)
 {
-    // create socket
-    _socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (_socket == -1) {
-        std::cerr << "Failed to create socket: " << errno << "\n";
+    Close();
+
+    _host = host;
+    _port = port;
+    _failures = 0;
+    if (!Resolve()) {
+        _host.clear();
         return false;
     }
 
-    // set non-blocking
-    int flags = fcntl(_socket, F_GETFL, 0);
-    fcntl(_socket, F_SETFL, flags | O_NONBLOCK);
-
-    // server address
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port   = htons(port);
+    std::cout << "Connecting to " << host << ":" << port << "...\n";
+    _connectDeadline = Clock::now() + connect_timeout;
+    StartAttempt();
+    if (!_connected && _attempts.empty())
+        FailConnect("no address reachable");
+    return true;
+}
 
-    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
-        std::cerr << "Invalid address\n";
-        close(_socket);
+bool Client::Resolve()
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    addrinfo* results = nullptr;
+    int error = getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints, &results);
+    if (error != 0) {
+        std::cerr << "Failed to resolve " << _host << ": " << gai_strerror(error) << "\n";
         return false;
     }
 
-    // attempt connect
-    int result = connect(_socket, (sockaddr*)&addr, sizeof(addr));
+    // keep the resolver's preference, but alternate families so one broken
+    // address family costs a single attempt_delay
+    std::vector<sockaddr_storage> primary, secondary;
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        sockaddr_storage addr{};
+        memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+        (ai->ai_family == results->ai_family ? primary : secondary).push_back(addr);
+    }
+    freeaddrinfo(results);
+
+    _addresses.clear();
+    for (size_t i = 0; i < std::max(primary.size(), secondary.size()); i++) {
+        if (i < primary.size())
+            _addresses.push_back(primary[i]);
+        if (i < secondary.size())
+            _addresses.push_back(secondary[i]);
+    }
+    _nextAddress = 0;
+    return !_addresses.empty();
+}
 
-    if (result == 0) {
-        // connected instantly
-        std::cout << "Succesfully connected to " << host << ":" << port << "\n";
-        _connected = true;
-        return true;
+void Client::StartAttempt()
+{
+    // addresses that fail right away don't wait for attempt_delay
+    while (_nextAddress < _addresses.size())
+    {
+        Attempt attempt{};
+        attempt.addr = _addresses[_nextAddress++];
+        attempt.length = attempt.addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+
+        attempt.fd = socket(attempt.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (attempt.fd == -1) {
+            std::cerr << "Failed to create socket: " << errno << "\n";
+            continue;
+        }
+
+        _lastAttempt = Clock::now();
+        int result = connect(attempt.fd, (sockaddr*)&attempt.addr, attempt.length);
+        if (result == 0) {
+            // connected instantly
+            Connected(attempt);
+            return;
+        }
+        if (errno == EINPROGRESS) {
+            _attempts.push_back(attempt);
+            return;
+        }
+
+        std::cerr << "Connect failed: " << strerror(errno) << "\n";
+        close(attempt.fd);
     }
+}
 
-    // non-blocking in-progress connect
-    if (result == -1 && errno == EINPROGRESS) {
-        std::cout << "Connecting to " << host << ":" << port << "...\n";
-        // loop will call HandleReceive until fully connected
-        _connected = true;  // mark as "attempting"
-        std::cout << "Succesfully connected to " << host << ":" << port << "\n";
-        return true;
+void Client::PollConnect()
+{
+    auto now = Clock::now();
+
+    // waiting out the backoff after a failure
+    if (_attempts.empty() && _nextAddress >= _addresses.size()) {
+        if (_host.empty() || now < _retryAt)
+            return;
+
+        std::cout << "Reconnecting to " << _host << ":" << _port << "...\n";
+        if (!Resolve()) {
+            FailConnect("resolve failed");
+            return;
+        }
+        _connectDeadline = now + connect_timeout;
+        StartAttempt();
+        if (_connected || !_attempts.empty())
+            return;
     }
 
-    std::cerr << "Connect failed: " << strerror(errno) << "\n";
-    close(_socket);
-    return false;
+    std::vector<pollfd> fds;
+    for (const Attempt& attempt : _attempts) {
+        fds.push_back(pollfd{ attempt.fd, POLLOUT, 0 });
+    }
+
+    if (!fds.empty() && poll(fds.data(), fds.size(), 0) > 0) {
+        // walk backwards so failed attempts can be erased in place
+        for (size_t i = fds.size(); i-- > 0; ) {
+            if (fds[i].revents == 0)
+                continue;
+
+            // writable only says the handshake ended, SO_ERROR says how
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == 0) {
+                Attempt winner = _attempts[i];
+                _attempts.erase(_attempts.begin() + i);
+                Connected(winner);
+                return;
+            }
+
+            std::cerr << "Connect failed: " << strerror(error) << "\n";
+            close(_attempts[i].fd);
+            _attempts.erase(_attempts.begin() + i);
+        }
+    }
+
+    if (now >= _connectDeadline) {
+        FailConnect("connect timed out");
+        return;
+    }
+
+    // the next address joins the race, right away if nothing is pending
+    if (_attempts.empty() || now - _lastAttempt >= attempt_delay)
+        StartAttempt();
+
+    if (!_connected && _attempts.empty())
+        FailConnect("no address reachable");
+}
+
+void Client::Connected(const Attempt& attempt)
+{
+    // the losers of the race are no longer needed
+    CloseAttempts();
+    _nextAddress = _addresses.size();
+
+    _socket = attempt.fd;
+    _connected = true;
+    _failures = 0;
+
+    _serverAddr = {};
+    if (attempt.addr.ss_family == AF_INET)
+        memcpy(&_serverAddr, &attempt.addr, sizeof(sockaddr_in));
+
+    char address[INET6_ADDRSTRLEN] = "";
+    const void* raw = attempt.addr.ss_family == AF_INET6
+        ? (const void*)&((const sockaddr_in6*)&attempt.addr)->sin6_addr
+        : (const void*)&((const sockaddr_in*)&attempt.addr)->sin_addr;
+    inet_ntop(attempt.addr.ss_family, raw, address, sizeof(address));
+    std::cout << "Succesfully connected to " << address << ":" << _port << "\n";
+
+    // frames queued while down still go out unsealed, the checksum
+    // request follows them
+    NegotiateChecksums();
+    FlushSends();
+}
+
+void Client::FailConnect(const std::string& reason)
+{
+    CloseAttempts();
+    _nextAddress = _addresses.size();
+
+    // equal jitter: half the delay fixed, half random, so clients that lost
+    // the same server don't all come back in the same tick
+    auto delay = std::min<std::chrono::milliseconds>(backoff_max, backoff_base * (1 << std::min(_failures, 16)));
+    std::uniform_int_distribution<int64_t> jitter(0, delay.count() / 2);
+    _retryAt = Clock::now() + delay / 2 + std::chrono::milliseconds(jitter(_random));
+    _failures++;
+
+    std::cerr << _host << ":" << _port << ": " << reason << ", retrying in " << std::chrono::duration_cast<std::chrono::milliseconds>(_retryAt - Clock::now()).count() << " ms\n";
+}
+
+void Client::CloseAttempts()
+{
+    for (const Attempt& attempt : _attempts) {
+        close(attempt.fd);
+    }
+    _attempts.clear();
 }
 
 void Client::HandleReceive()
 {
-    if (!_connected)
+    if (!_connected) {
+        PollConnect();
+        if (!_connected)
+            return;
+    }
+
+    FlushSends();
+    ReceiveDatagrams();
+    ReceiveFrame();
+
+    if (_udpSession != 0 && !_udpConfirmed) {
+        UdpSessionMessage msg;
+        msg.session = _udpSession;
+        _udp.Queue(msg);
+    }
+    _udp.Flush();
+}
+
+void Client::ReceiveDatagrams()
+{
+    _udp.Receive([this](unsigned char messageId, Decoder& decoder, const sockaddr_in&) {
+        if (messageId == constants::udp_session_id) {
+            _udpConfirmed = true;
+            return;
+        }
+        Dispatch(messageId, decoder);
+    });
+}
+
+void Client::OpenDatagrams(uint32_t session)
+{
+    // the datagram channel is IPv4 only
+    if (_serverAddr.sin_family != AF_INET)
+        return;
+
+    if (!_udp.open() && !_udp.Open(0)) {
+        return;
+    }
+
+    // the server uses the same port number for UDP
+    _udp.SetSession(session);
+    _udp.SetPeer(_serverAddr);
+    _udpSession = session;
+    _udpConfirmed = false;
+}
+
+void Client::SetChecksums(bool enabled)
+{
+    _wantChecksums = enabled;
+    if (_connected)
+        NegotiateChecksums();
+}
+
+void Client::NegotiateChecksums()
+{
+    if (_wantChecksums == _checksums)
+        return;
+
+    // the request itself still goes out in the current mode; the server
+    // reads frames in order and switches right after it
+    IntegrityMessage msg;
+    msg.checksums = _wantChecksums;
+    Send(msg);
+
+    _checksums = _wantChecksums;
+    if (!_checksums)
+        _requireChecksums = false;
+}
+
+void Client::ReceiveFrame()
+{
+    // raw blob bytes come before any further frames
+    if (_blobRemaining > 0) {
+        ReceiveBlob();
         return;
+    }
 
     // peek size
     if (_currentSize == 0)
@@ -83,7 +330,7 @@ void Client::HandleReceive()
         int result = recv(_socket, reinterpret_cast<char*>(&bytesReadable), sizeof(int), MSG_PEEK);
 
         if (result <= 0) {
-            if (errno == EWOULDBLOCK)
+            if (result < 0 && errno == EWOULDBLOCK)
                 return;
 
             // socket closed
@@ -94,31 +341,96 @@ void Client::HandleReceive()
         if (result < sizeof(int))
             return;
 
-        _currentSize = ntohl(bytesReadable);
-        if (_currentSize <= 0 || _currentSize > 8192) {
+        int length = ntohl(bytesReadable);
+        _currentChecksum = (length & constants::checksum_flag) != 0;
+        _currentSize = length & ~constants::checksum_flag;
+
+        // the prefix, the id byte and the trailer if there is one
+        int minimumSize = 5 + (_currentChecksum ? sizeof(uint32_t) : 0);
+        if (_currentSize < minimumSize || _currentSize > constants::max_frame_size) {
             Disconnect("invalid message size");
             return;
         }
+        _frame.resize(_currentSize);
+        _received = 0;
     }
 
-    // read full message
-    std::vector<char> buffer(_currentSize);
-    int result = recv(_socket, buffer.data(), _currentSize, 0);
+    // read the rest of the message, it may take several ticks to arrive
+    int result = recv(_socket, _frame.data() + _received, _currentSize - _received, 0);
 
     if (result <= 0) {
-        if (errno == EWOULDBLOCK)
+        if (result < 0 && errno == EWOULDBLOCK)
             return;
 
         Disconnect("recv failed");
         return;
     }
 
+    _received += result;
+    if (_received < _currentSize)
+        return;
+
+    const std::vector<char>& buffer = _frame;
+
+    // checked only once the whole frame is in
+    if (_currentChecksum) {
+        if (!VerifyChecksum(buffer.data(), _currentSize)) {
+            Disconnect("frame checksum mismatch");
+            return;
+        }
+    }
+    else if (_requireChecksums) {
+        Disconnect("frame without negotiated checksum");
+        return;
+    }
+
     // decode (you implement Decoder)
-    Decoder decoder(buffer.data() + 4, _currentSize);
+    int payloadSize = _currentSize - 4 - (_currentChecksum ? sizeof(uint32_t) : 0);
+    Decoder decoder(buffer.data() + 4, payloadSize);
 
     unsigned char messageId;
     decoder.ReadByte(&messageId);
 
+    switch ((int)messageId)
+    {
+        case constants::blob_id: {
+            BlobMessage msg;
+            msg.decode(decoder);
+
+            std::cout << "Receiving blob: " << msg.name << " (" << msg.length << " bytes)\n";
+            _blobRemaining = msg.length;
+            _blobFd = _blobSink ? _blobSink(msg.name, msg.length) : -1;
+            _currentSize = 0;
+
+            ReceiveBlob();
+            return;
+        }
+        case constants::integrity_id: {
+            IntegrityMessage msg;
+            msg.decode(decoder);
+
+            // everything the server sends from here on is sealed
+            _requireChecksums = msg.checksums;
+            break;
+        }
+        case constants::udp_session_id: {
+            UdpSessionMessage msg;
+            msg.decode(decoder);
+
+            OpenDatagrams(msg.session);
+            break;
+        }
+        default: {
+            Dispatch(messageId, decoder);
+            break;
+        }
+    }
+
+    _currentSize = 0;
+}
+
+void Client::Dispatch(unsigned char messageId, Decoder& decoder)
+{
     std::cout << "Client got message ID = " << (int)messageId << "\n";
     switch ((int)messageId)
     {
@@ -128,35 +440,142 @@ void Client::HandleReceive()
 
             std::cout << "Server says:\nText: " << msg.text << "\nResult: " << msg.result << "\nSolved? - " << msg.solved << std::endl;
             std::cout << "PS: Message float value is: " << msg.test << std::endl;
+            _outstanding = std::max(0, _outstanding - 1);
+            break;
+        }
+        case constants::error_id: {
+            ErrorMessage msg;
+            msg.decode(decoder);
+
+            std::cerr << "Server error " << msg.code << ": " << msg.text << "\n";
+            _outstanding = std::max(0, _outstanding - 1);
+            break;
+        }
+        case constants::state_id: {
+            StateMessage msg;
+            msg.decode(decoder);
+
+            std::cout << "State update for entity " << msg.entity << " (" << msg.values.size() << " values)\n";
+            break;
         }
     }
+}
 
-    _currentSize = 0;
+void Client::ReceiveBlob()
+{
+    while (_blobRemaining > 0)
+    {
+        size_t chunk = std::min<int64_t>(_blobRemaining, 1 << 16);
+        ssize_t result;
+
+        if (_blobFd != -1) {
+            if (_pipe[0] == -1 && pipe2(_pipe, O_NONBLOCK) == -1) {
+                Disconnect("failed to create splice pipe");
+                return;
+            }
+
+            // socket -> pipe -> file without copying through user space
+            result = splice(_socket, nullptr, _pipe[1], nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            for (ssize_t left = result; left > 0; ) {
+                ssize_t written = splice(_pipe[0], nullptr, _blobFd, nullptr, left, SPLICE_F_MOVE);
+                if (written <= 0) {
+                    std::cerr << "Blob sink write failed: " << strerror(errno) << "\n";
+                    Disconnect("blob sink failed");
+                    return;
+                }
+                left -= written;
+            }
+        }
+        else {
+            char scratch[16384];
+            result = recv(_socket, scratch, std::min(chunk, sizeof(scratch)), 0);
+        }
+
+        if (result == 0) {
+            Disconnect("connection lost");
+            return;
+        }
+        if (result < 0) {
+            if (errno == EWOULDBLOCK)
+                return;
+
+            Disconnect("blob receive failed");
+            return;
+        }
+        _blobRemaining -= result;
+    }
+
+    std::cout << "Blob received\n";
+    FinishBlob();
+}
+
+void Client::FinishBlob()
+{
+    if (_blobFd != -1) {
+        close(_blobFd);
+        _blobFd = -1;
+    }
+    _blobRemaining = 0;
 }
 
 void Client::Send(Message& message)
 {
-    if (!_connected)
+    // sent with the next HandleReceive tick's batch; stale while down
+    if (message.delivery() == Delivery::Unreliable && (!_connected || _udp.Queue(message)))
         return;
 
+    if (_host.empty()) {
+        std::cerr << "Send without Connect\n";
+        return;
+    }
+
     Encoder encoder;
     message.encode(encoder);
+    if (_checksums)
+        encoder.Seal();
 
-    const char* buf = encoder.buffer();
-    int size = encoder.size();
+    if (_sendQueue.size() + encoder.size() > max_queued_bytes) {
+        std::cerr << "Send queue full, dropping message\n";
+        return;
+    }
+    _sendQueue.insert(_sendQueue.end(), encoder.buffer(), encoder.buffer() + encoder.size());
 
-    int result = send(_socket, buf, size, 0);
-    if (result <= 0) {
-        if (errno != EWOULDBLOCK) {
-            Disconnect("send failed");
+    if (message.expectsReply())
+        _outstanding++;
+
+    if (_connected)
+        FlushSends();
+}
+
+void Client::FlushSends()
+{
+    while (_connected && _sendOffset < _sendQueue.size())
+    {
+        ssize_t result = send(_socket, _sendQueue.data() + _sendOffset, _sendQueue.size() - _sendOffset, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EWOULDBLOCK)
+                Disconnect("send failed");
+            return;
         }
+        _sendOffset += result;
+    }
+
+    if (_sendOffset == _sendQueue.size()) {
+        _sendQueue.clear();
+        _sendOffset = 0;
     }
 }
 
 void Client::Disconnect(const std::string& reason)
 {
-    if (!_connected)
+    if (!_connected) {
+        // give up on a pending attempt, PollConnect retries later
+        if (!_attempts.empty())
+            FailConnect(reason);
         return;
+    }
 
     std::cout << "Client disconnect: " << reason << "\n";
 
@@ -164,4 +583,48 @@ void Client::Disconnect(const std::string& reason)
     _socket = -1;
     _connected = false;
     _currentSize = 0;
+    _outstanding = 0;
+    _checksums = false;
+    _requireChecksums = false;
+    FinishBlob();
+
+    _udp.SetSession(0);
+    _udpSession = 0;
+    _udpConfirmed = false;
+
+    // unsent frames carry over to the next connection, except checksum
+    // requests, which are renegotiated there. A partly written frame never
+    // reached the handler, so it is sent again whole.
+    size_t kept = 0;
+    for (size_t frame = 0; frame < _sendQueue.size(); ) {
+        int length;
+        memcpy(&length, _sendQueue.data() + frame, sizeof(int));
+        size_t size = ntohl(length) & ~constants::checksum_flag;
+
+        bool sent = frame + size <= _sendOffset;
+        if (!sent && (unsigned char)_sendQueue[frame + 4] != constants::integrity_id) {
+            memmove(_sendQueue.data() + kept, _sendQueue.data() + frame, size);
+            kept += size;
+        }
+        frame += size;
+    }
+    _sendQueue.resize(kept);
+    _sendOffset = 0;
+
+    // the first retry comes quickly after a working connection was lost
+    if (!_host.empty())
+        FailConnect(reason);
+}
+
+void Client::Close()
+{
+    // without a host Disconnect does not schedule a reconnect
+    _host.clear();
+    CloseAttempts();
+    Disconnect("closed");
+    _addresses.clear();
+    _nextAddress = 0;
+    _sendQueue.clear();
+    _sendOffset = 0;
+    FinishBlob();
 }
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <algorithm>
+#include <client_pool.hpp>
+#include <message.hpp>
+
+// FNV-1a with a splitmix64 finalizer, so similar keys spread over the ring
+static uint64_t HashKey(std::string_view key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+ClientPool::ClientPool(int connectionsPerNode, int virtualNodes)
+: _connectionsPerNode(std::max(1, connectionsPerNode)), _virtualNodes(std::max(1, virtualNodes))
+{}
+
+void ClientPool::AddNode(const std::string& host, int port)
+{
+    auto node = std::make_unique<Node>();
+    node->host = host;
+    node->port = port;
+    node->name = host + ":" + std::to_string(port);
+    node->healthy = false;
+
+    for (int i = 0; i < _connectionsPerNode; i++) {
+        node->connections.push_back(std::make_unique<Client>());
+    }
+
+    // joins the ring from HandleReceive once every connection is up
+    if (!ConnectNode(*node)) {
+        std::cerr << "Pool node " << node->name << " does not resolve\n";
+        return;
+    }
+
+    _nodes.push_back(std::move(node));
+}
+
+void ClientPool::RemoveNode(const std::string& host, int port)
+{
+    auto it = std::find_if(_nodes.begin(), _nodes.end(), [&](const std::unique_ptr<Node>& node) {
+        return node->host == host && node->port == port;
+    });
+    if (it == _nodes.end()) {
+        return;
+    }
+
+    _nodes.erase(it);
+    RebuildRing();
+}
+
+bool ClientPool::Send(std::string_view key, Message& message)
+{
+    const Node* node = Lookup(key);
+    if (!node) {
+        return false;
+    }
+
+    // least outstanding requests among the node's live connections
+    Client* best = nullptr;
+    for (const std::unique_ptr<Client>& client : node->connections) {
+        if (client->connected() && (!best || client->outstanding() < best->outstanding())) {
+            best = client.get();
+        }
+    }
+    if (!best) {
+        return false;
+    }
+
+    best->Send(message);
+    return best->connected();
+}
+
+void ClientPool::HandleReceive()
+{
+    for (std::unique_ptr<Node>& node : _nodes) {
+        for (std::unique_ptr<Client>& client : node->connections) {
+            client->HandleReceive();
+        }
+
+        // one broken connection is enough to stop routing to the node
+        bool alive = std::all_of(node->connections.begin(), node->connections.end(),
+            [](const std::unique_ptr<Client>& client) { return client->connected(); });
+
+        if (!alive && node->healthy) {
+            FailNode(*node, "connection lost");
+        }
+        else if (alive && !node->healthy) {
+            std::cout << "Pool node " << node->name << " is up\n";
+            node->healthy = true;
+            RebuildRing();
+        }
+    }
+}
+
+size_t ClientPool::healthyNodes() const
+{
+    return std::count_if(_nodes.begin(), _nodes.end(), [](const std::unique_ptr<Node>& node) {
+        return node->healthy;
+    });
+}
+
+std::string ClientPool::Route(std::string_view key) const
+{
+    const Node* node = Lookup(key);
+    return node ? node->name : std::string();
+}
+
+bool ClientPool::ConnectNode(Node& node)
+{
+    for (std::unique_ptr<Client>& client : node.connections) {
+        if (!client->Connect(node.host, node.port)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ClientPool::FailNode(Node& node, const std::string& reason)
+{
+    std::cerr << "Pool node " << node.name << " down: " << reason << "\n";
+
+    // the connections that are still up keep theirs, the broken ones are
+    // already reconnecting
+    node.healthy = false;
+    RebuildRing();
+}
+
+void ClientPool::RebuildRing()
+{
+    _ring.clear();
+    for (std::unique_ptr<Node>& node : _nodes) {
+        if (!node->healthy) {
+            continue;
+        }
+        for (int i = 0; i < _virtualNodes; i++) {
+            _ring.emplace_back(HashKey(node->name + "#" + std::to_string(i)), node.get());
+        }
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+const ClientPool::Node* ClientPool::Lookup(std::string_view key) const
+{
+    if (_ring.empty()) {
+        return nullptr;
+    }
+
+    // first point clockwise from the key's hash, wrapping around
+    uint64_t hash = HashKey(key);
+    auto it = std::lower_bound(_ring.begin(), _ring.end(), hash,
+        [](const std::pair<uint64_t, Node*>& point, uint64_t value) { return point.first < value; });
+    if (it == _ring.end()) {
+        it = _ring.begin();
+    }
+    return it->second;
+}
@@ -0,0 +1,71 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <array>
+#include <cstdint>
+
+// Classic token bucket: refills at `rate` tokens per second up to `burst`.
+// A rate of 0 means unlimited.
+class TokenBucket
+{
+public:
+    TokenBucket() : _rate(0), _burst(0), _tokens(0), _last(0) {}
+
+    void Configure(double rate, double burst);
+    void Refill(int64_t nowNs) { _tokens = _burst; _last = nowNs; }
+    bool TryTake(int64_t nowNs);
+
+    bool limited() const { return _rate > 0; }
+
+private:
+    double  _rate;
+    double  _burst;
+    double  _tokens;
+    int64_t _last;
+};
+
+// Decides whether an inbound frame gets handled or is rejected before it is
+// decoded. Frames are checked against the connection's bucket, then the
+// bucket for their message id, and finally against queue latency: once the
+// time frames spend waiting in the socket receive queue stays above the
+// target for a whole interval, every frame that waited longer than the target
+// is shed until one arrives under it again.
+class AdmissionControl
+{
+public:
+    enum class Verdict { Admit, RateLimited, Overloaded };
+
+    struct Stats {
+        uint64_t admitted = 0;
+        uint64_t rateLimited = 0;
+        uint64_t shed = 0;
+    };
+
+    AdmissionControl();
+
+    void SetConnectionLimit(double rate, double burst);
+    void SetMessageLimit(unsigned char messageId, double rate, double burst);
+    void SetQueueLatencyTarget(int64_t targetNs, int64_t intervalNs);
+
+    // Refill all buckets for a new connection
+    void Reset(int64_t nowNs);
+
+    // A negative queueLatencyNs means unknown (no kernel timestamp)
+    Verdict Admit(unsigned char messageId, int64_t queueLatencyNs, int64_t nowNs);
+
+    bool shedding() const { return _shedding; }
+    const Stats& stats() const { return _stats; }
+
+private:
+    TokenBucket _connection;
+    std::array<TokenBucket, 256> _messages;
+
+    int64_t _targetNs;     // 0 disables latency based shedding
+    int64_t _intervalNs;
+    int64_t _aboveSince;   // when queue latency first went over target, or 0
+    bool    _shedding;
+
+    Stats _stats;
+};
+
+#endif
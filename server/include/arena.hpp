@@ -0,0 +1,86 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for per-request temporaries. Nothing is freed individually;
+// Reset() releases everything at once and keeps the chunks for the next
+// request, so a warmed-up arena never touches the global heap.
+class Arena : public std::pmr::memory_resource
+{
+public:
+    explicit Arena(size_t chunkSize = 16384) : _chunkSize(chunkSize), _current(0), _offset(0) {}
+
+    ~Arena() {
+        for (Chunk& chunk : _chunks) {
+            ::operator delete(chunk.data);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        while (_current < _chunks.size()) {
+            Chunk& chunk = _chunks[_current];
+            size_t start = (_offset + alignment - 1) & ~(alignment - 1);
+            if (start + size <= chunk.size) {
+                _offset = start + size;
+                return chunk.data + start;
+            }
+            _current++;
+            _offset = 0;
+        }
+
+        // out of retained chunks, add one big enough for this request
+        size_t chunkSize = std::max(_chunkSize, size + alignment);
+        _chunks.push_back({ static_cast<char*>(::operator new(chunkSize)), chunkSize });
+        _current = _chunks.size() - 1;
+        _offset = 0;
+        return Allocate(size, alignment);
+    }
+
+    void Reset() {
+        _current = 0;
+        _offset = 0;
+    }
+
+    // Resets the arena when the current request goes out of scope
+    class Scope
+    {
+    public:
+        explicit Scope(Arena& arena) : _arena(arena) {}
+        ~Scope() { _arena.Reset(); }
+
+    private:
+        Arena& _arena;
+    };
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        return Allocate(size, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    struct Chunk {
+        char*  data;
+        size_t size;
+    };
+
+    size_t _chunkSize;
+    std::vector<Chunk> _chunks;
+    size_t _current;
+    size_t _offset;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Binary traffic log of inbound frames.
+//
+// Layout: a 16 byte file header ("NCAP", version, reserved) followed by
+// records of { uint64 timestamp ns since capture start, uint32 frame size,
+// frame bytes } in host byte order. Records are unpadded; a zero size marks
+// the end of the log (the unused tail of the mapping after a crash).
+//
+// Since version 2 a record sized connection_marker, with no frame bytes,
+// marks where a new client connection starts. Version 1 logs hold a single
+// connection's frames without markers.
+namespace capture {
+    constexpr char magic[4] = { 'N', 'C', 'A', 'P' };
+    constexpr uint32_t version = 2;
+    constexpr uint32_t min_version = 1;
+    constexpr size_t header_size = 16;
+    constexpr size_t record_header_size = sizeof(uint64_t) + sizeof(uint32_t);
+    constexpr uint32_t connection_marker = UINT32_MAX;
+}
+
+// Append-only writer backed by a growing shared file mapping
+class CaptureWriter
+{
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    bool Open(const std::string& path);
+    void Append(const char* frame, uint32_t size);
+    void MarkConnection();
+    void Close();
+
+    bool open() const { return _fd != -1; }
+    uint64_t records() const { return _records; }
+
+private:
+    bool Reserve(size_t size);
+    void Write(const char* frame, uint32_t size, uint32_t recordSize);
+
+private:
+    int      _fd;
+    char*    _map;
+    size_t   _mapSize;
+    size_t   _used;
+    uint64_t _records;
+    int64_t  _start;
+};
+
+// Sequential reader over a memory-mapped log
+class CaptureReader
+{
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    bool Open(const std::string& path);
+
+    // Returns false at the end of the log. A connection marker is returned
+    // as a record with a null frame and a zero size.
+    bool Next(uint64_t* timestamp, const char** frame, uint32_t* size);
+    void Rewind() { _position = capture::header_size; }
+
+private:
+    char*  _map;
+    size_t _mapSize;
+    size_t _position;
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef DATAGRAM_HPP
+#define DATAGRAM_HPP
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <message.hpp>
+
+// Unreliable, latest-wins UDP channel running next to a TCP session.
+//
+// Every datagram is { uint32 session, uint32 sequence } in network order
+// followed by one regular Encoder frame. The session token is handed out over
+// TCP, sequences count per message id, and the receiver drops datagrams that
+// are older than the newest one it has seen for that id. Queued datagrams are
+// coalesced per message id (a newer message replaces an unsent older one) and
+// sent in one sendmmsg() call by Flush(); Receive() drains up to a batch per
+// recvmmsg() call.
+class DatagramChannel
+{
+public:
+    static constexpr size_t max_batch = 32;
+    static constexpr size_t header_size = 8;
+    // keep datagrams below a typical path MTU so they are never fragmented
+    static constexpr size_t max_datagram = 1400;
+
+    DatagramChannel() : _socket(-1), _session(0), _hasPeer(false), _pendingCount(0) {
+        _pendingSlot.fill(-1);
+        _receiveBuffers.resize(max_batch * max_datagram);
+        for (Pending& pending : _pending) {
+            pending.encoder.Reset();
+        }
+    }
+
+    ~DatagramChannel() { Close(); }
+
+    DatagramChannel(const DatagramChannel&) = delete;
+    DatagramChannel& operator=(const DatagramChannel&) = delete;
+
+    // Binds a non-blocking UDP socket, port 0 picks an ephemeral one
+    bool Open(int port) {
+        Close();
+
+        _socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_socket == -1) {
+            std::cerr << "Failed to create datagram socket: " << errno << std::endl;
+            return false;
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(_socket, (sockaddr*)&addr, sizeof(addr)) == -1) {
+            std::cerr << "Failed to bind datagram socket: " << errno << std::endl;
+            Close();
+            return false;
+        }
+
+        fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    // Takes over an already bound socket, e.g. one handed over on restart
+    void Adopt(int socket) {
+        Close();
+        _socket = socket;
+        fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+    }
+
+    void Close() {
+        if (_socket != -1) {
+            close(_socket);
+            _socket = -1;
+        }
+        SetSession(0);
+    }
+
+    // Starts a new session; 0 disables the channel until a session is set
+    void SetSession(uint32_t session) {
+        _session = session;
+        _hasPeer = false;
+        _sendSequence.fill(0);
+        _receiveSequence.fill(0);
+        _pendingSlot.fill(-1);
+        _pendingCount = 0;
+    }
+
+    void SetPeer(const sockaddr_in& peer) {
+        _peer = peer;
+        _hasPeer = true;
+    }
+
+    // Datagrams can be sent once there is a session and a known peer
+    bool ready() const { return _socket != -1 && _session != 0 && _hasPeer; }
+    bool open() const { return _socket != -1; }
+
+    int fd() const { return _socket; }
+    uint32_t session() const { return _session; }
+    bool hasPeer() const { return _hasPeer; }
+    const sockaddr_in& peer() const { return _peer; }
+
+    // Encodes the message into the batch, returns false if it has to go over
+    // TCP instead (no session yet or too large for one datagram)
+    bool Queue(Message& message) {
+        if (!ready()) {
+            return false;
+        }
+
+        if (_pendingCount == max_batch) {
+            Flush();
+        }
+
+        Pending& pending = _pending[_pendingCount];
+        pending.encoder.Reset();
+        message.encode(pending.encoder);
+        if (header_size + pending.encoder.size() > max_datagram) {
+            return false;
+        }
+
+        unsigned char id = pending.encoder.buffer()[sizeof(int)];
+        pending.id = id;
+        pending.sequence = ++_sendSequence[id];
+
+        // latest wins: replace an unsent datagram with the same id
+        if (_pendingSlot[id] != -1) {
+            std::swap(_pending[_pendingSlot[id]], pending);
+            return true;
+        }
+        _pendingSlot[id] = _pendingCount++;
+        return true;
+    }
+
+    // Sends everything queued in one system call
+    bool Flush() {
+        if (_pendingCount == 0) {
+            return true;
+        }
+
+        std::array<mmsghdr, max_batch> messages{};
+        std::array<iovec, max_batch * 2> iov;
+        std::array<std::array<uint32_t, 2>, max_batch> headers;
+
+        for (size_t i = 0; i < _pendingCount; i++) {
+            Pending& pending = _pending[i];
+            headers[i] = { htonl(_session), htonl(pending.sequence) };
+            iov[i * 2] = { headers[i].data(), header_size };
+            iov[i * 2 + 1] = { (void*)pending.encoder.buffer(), (size_t)pending.encoder.size() };
+
+            messages[i].msg_hdr.msg_iov = &iov[i * 2];
+            messages[i].msg_hdr.msg_iovlen = 2;
+            messages[i].msg_hdr.msg_name = &_peer;
+            messages[i].msg_hdr.msg_namelen = sizeof(_peer);
+        }
+
+        int count = _pendingCount;
+        _pendingSlot.fill(-1);
+        _pendingCount = 0;
+
+        // state updates are droppable by design, a full socket buffer just
+        // loses this batch
+        int result = sendmmsg(_socket, messages.data(), count, 0);
+        if (result == -1 && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+            std::cerr << "Datagram send failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Calls handler(messageId, decoder, from) for every datagram of the
+    // current session that is newer than the last one seen for its id.
+    // Returns the number of datagrams handled.
+    template <typename Handler>
+    int Receive(Handler&& handler) {
+        if (_socket == -1 || _session == 0) {
+            return 0;
+        }
+
+        std::array<mmsghdr, max_batch> messages{};
+        std::array<iovec, max_batch> iov;
+        std::array<sockaddr_in, max_batch> from;
+
+        for (size_t i = 0; i < max_batch; i++) {
+            iov[i] = { _receiveBuffers.data() + i * max_datagram, max_datagram };
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &from[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        int count = recvmmsg(_socket, messages.data(), max_batch, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            return 0;
+        }
+
+        int handled = 0;
+        for (int i = 0; i < count; i++) {
+            const char* data = _receiveBuffers.data() + i * max_datagram;
+            size_t size = messages[i].msg_len;
+            if (size < header_size + sizeof(int) + 1 || (messages[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                continue;
+            }
+
+            uint32_t session, sequence;
+            int length;
+            memcpy(&session, data, sizeof(uint32_t));
+            memcpy(&sequence, data + 4, sizeof(uint32_t));
+            memcpy(&length, data + header_size, sizeof(int));
+            if (ntohl(session) != _session || (size_t)ntohl(length) != size - header_size) {
+                continue;
+            }
+
+            // drop anything not newer than what we already have (wrap safe)
+            unsigned char id = data[header_size + sizeof(int)];
+            sequence = ntohl(sequence);
+            if ((int32_t)(sequence - _receiveSequence[id]) <= 0) {
+                continue;
+            }
+            _receiveSequence[id] = sequence;
+
+            Decoder decoder(data + header_size + sizeof(int) + 1, size - header_size - sizeof(int) - 1);
+            try {
+                handler(id, decoder, from[i]);
+                handled++;
+            }
+            catch (const std::runtime_error& e) {
+                std::cerr << "Dropping malformed datagram: " << e.what() << std::endl;
+            }
+        }
+        return handled;
+    }
+
+private:
+    struct Pending {
+        Encoder encoder;
+        unsigned char id;
+        uint32_t sequence;
+    };
+
+    int         _socket;
+    uint32_t    _session;
+    sockaddr_in _peer;
+    bool        _hasPeer;
+
+    std::array<uint32_t, 256> _sendSequence;
+    std::array<uint32_t, 256> _receiveSequence;
+
+    // queued datagrams, and which slot holds the queued one for each id
+    std::array<Pending, max_batch> _pending;
+    std::array<int, 256> _pendingSlot;
+    size_t _pendingCount;
+
+    std::vector<char> _receiveBuffers;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef HANDOFF_HPP
+#define HANDOFF_HPP
+
+#include <cstddef>
+#include <sys/types.h>
+
+// Passing open sockets between processes over a Unix domain socket, used by
+// hot restart. Descriptors travel as SCM_RIGHTS ancillary data next to a
+// regular payload; the receiver gets its own duplicates.
+namespace handoff {
+    constexpr int max_fds = 4;
+
+    // How long either side waits for the other during a handoff
+    constexpr int timeout_ms = 5000;
+
+    // Sent by the new process to ask for the listener only or for the live
+    // connection too
+    constexpr char request_listener = 'L';
+    constexpr char request_connection = 'C';
+    constexpr char ack = 'A';
+
+    bool SendFds(int socket, const char* data, size_t size, const int* fds, int count);
+
+    // Returns the payload size or -1; *count is set to the descriptors received
+    ssize_t ReceiveFds(int socket, char* data, size_t size, int* fds, int* count);
+
+    // Blocking single byte exchange bounded by timeout_ms
+    bool SendByte(int socket, char value);
+    bool ReceiveByte(int socket, char* value);
+}
+
+#endif
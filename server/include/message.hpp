@@ -2,17 +2,43 @@
 #define MESSAGE_H
 
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <string.h>
+#include <endian.h>
 #include <iterator>
 #include <stdexcept>
 
+#include <byteorder.hpp>
+#include <crc32c.hpp>
+
 class Encoder {
 public:
-    Encoder() : _position(0) {
+    Encoder() : _position(0), _sealed(false) {
         // Reserve enough space for the size of this buffer
         WriteInt(0);
     }
 
+    // Starts a new frame, keeping the buffer's capacity for reuse
+    void Reset() {
+        _buffer.clear();
+        _position = 0;
+        _sealed = false;
+        WriteInt(0);
+    }
+
+    // Appends a CRC32C trailer covering the length prefix and payload and
+    // marks the prefix with constants::checksum_flag. Nothing may be written
+    // to the frame afterwards.
+    void Seal() {
+        int length = htonl((_position + sizeof(uint32_t)) | constants::checksum_flag);
+        memcpy(_buffer.data(), &length, sizeof(int));
+
+        uint32_t crc = htonl(crc32c::Compute(_buffer.data(), _position));
+        Write(reinterpret_cast<char*>(&crc), sizeof(uint32_t));
+        _sealed = true;
+    }
+
     void WriteBoolean(bool value) {
         Write((char*)&value, sizeof(bool));
     }
@@ -44,6 +70,39 @@ public:
         Write(reinterpret_cast<char*>(&asInt), sizeof(uint32_t));
     }
 
+    void WriteLong(int64_t value) {
+        uint64_t asInt = htobe64(static_cast<uint64_t>(value));
+        Write(reinterpret_cast<char*>(&asInt), sizeof(uint64_t));
+    }
+
+    void WriteDouble(double value) {
+        uint64_t asInt;
+        static_assert(sizeof(double) == sizeof(uint64_t), "Double must be 64-bit");
+
+        memcpy(&asInt, &value, sizeof(double));
+        asInt = htobe64(asInt);
+
+        Write(reinterpret_cast<char*>(&asInt), sizeof(uint64_t));
+    }
+
+    // Arrays are an int element count followed by the elements, converted
+    // to network byte order in bulk instead of one call per element
+    void WriteIntArray(const std::vector<int>& values) {
+        WriteArray(values.data(), values.size(), sizeof(int));
+    }
+
+    void WriteLongArray(const std::vector<int64_t>& values) {
+        WriteArray(values.data(), values.size(), sizeof(int64_t));
+    }
+
+    void WriteFloatArray(const std::vector<float>& values) {
+        WriteArray(values.data(), values.size(), sizeof(float));
+    }
+
+    void WriteDoubleArray(const std::vector<double>& values) {
+        WriteArray(values.data(), values.size(), sizeof(double));
+    }
+
     void WriteString(const std::string& value) {
         short size = value.length();
         WriteShort(size);
@@ -52,9 +111,10 @@ public:
 
     const char* buffer() const {
         // get the position and then copy to the front of the _buffer
-        int length = htonl(_position);
-        //std::cout << "length is: " << length << std::endl;
-        memcpy((char*)_buffer.data(), &length, sizeof(int));
+        if (!_sealed) {
+            int length = htonl(_position);
+            memcpy((char*)_buffer.data(), &length, sizeof(int));
+        }
         return _buffer.data();
     }
 
@@ -64,25 +124,55 @@ public:
 
 private:
     void Write(char *data, unsigned int size) {
-        // Reserve space in the buffer to avoid reallocations
-        _buffer.reserve(_buffer.size() + size);
-
-        // Copy data into buffer using std::copy
-        std::copy(data, data + size, std::back_inserter(_buffer));
+        // Append, letting the buffer grow geometrically
+        _buffer.insert(_buffer.end(), data, data + size);
 
         // Update position
         _position += size;
     }
 
+    void WriteArray(const void* data, size_t count, size_t width) {
+        WriteInt(static_cast<int>(count));
+
+        // Grow once and swap straight from the source into the buffer
+        size_t offset = _buffer.size();
+        _buffer.resize(offset + count * width);
+        if (width == 4) {
+            byteorder::Swap32(_buffer.data() + offset, data, count);
+        }
+        else {
+            byteorder::Swap64(_buffer.data() + offset, data, count);
+        }
+        _position += count * width;
+    }
+
 private:
     int _position;
+    bool _sealed;
     std::vector<char> _buffer;
 };
 
+// Checks the CRC32C trailer of a complete frame (length prefix included)
+// whose prefix has constants::checksum_flag set
+inline bool VerifyChecksum(const char* frame, int size) {
+    if (size < (int)(sizeof(int) + sizeof(uint32_t))) {
+        return false;
+    }
+
+    uint32_t expected;
+    memcpy(&expected, frame + size - sizeof(uint32_t), sizeof(uint32_t));
+    return crc32c::Compute(frame, size - sizeof(uint32_t)) == ntohl(expected);
+}
+
+// Reads from a caller-owned buffer, which must outlive the decoder
 class Decoder {
 public:
-    Decoder(const char* data, int size) : _buffer(data, data + size), _position(0)
-    { }
+    Decoder(const char* data, int size) : _buffer(data), _size(size), _position(0)
+    {
+        if (size < 0) {
+            throw std::runtime_error("Negative buffer size");
+        }
+    }
 
     void ReadBoolean(bool* value) {
         Read(reinterpret_cast<char*>(value), sizeof(bool));
@@ -113,30 +203,102 @@ public:
         memcpy(value, &asInt, sizeof(float));
     }
 
+    void ReadLong(int64_t* value) {
+        uint64_t asInt;
+        Read(reinterpret_cast<char*>(&asInt), sizeof(uint64_t));
+        *value = static_cast<int64_t>(be64toh(asInt));
+    }
+
+    void ReadDouble(double* value) {
+        uint64_t asInt;
+        Read(reinterpret_cast<char*>(&asInt), sizeof(uint64_t));
+        asInt = be64toh(asInt);
+        memcpy(value, &asInt, sizeof(double));
+    }
+
+    void ReadIntArray(std::vector<int>* values) {
+        values->resize(ReadArrayCount(sizeof(int)));
+        ReadArray(values->data(), values->size(), sizeof(int));
+    }
+
+    void ReadLongArray(std::vector<int64_t>* values) {
+        values->resize(ReadArrayCount(sizeof(int64_t)));
+        ReadArray(values->data(), values->size(), sizeof(int64_t));
+    }
+
+    void ReadFloatArray(std::vector<float>* values) {
+        values->resize(ReadArrayCount(sizeof(float)));
+        ReadArray(values->data(), values->size(), sizeof(float));
+    }
+
+    void ReadDoubleArray(std::vector<double>* values) {
+        values->resize(ReadArrayCount(sizeof(double)));
+        ReadArray(values->data(), values->size(), sizeof(double));
+    }
+
     void ReadString(std::string* value) {
         short size;
         ReadShort(&size);
+        if (size < 0 || _position + size > _size) {
+            throw std::runtime_error("Not enough data in buffer");
+        }
         value->assign(&_buffer[_position], size);
         _position += size;
     }
 
 private:
-    void Read(char* data, unsigned int size) {
-        if (_position + size > _buffer.size()) {
+    void Read(char* data, size_t size) {
+        if (size > (size_t)(_size - _position)) {
             throw std::runtime_error("Not enough data in buffer");
         }
         memcpy(data, &_buffer[_position], size);
         _position += size;
     }
 
+    // Reads and validates an array element count against the remaining bytes
+    size_t ReadArrayCount(size_t width) {
+        int count;
+        ReadInt(&count);
+        if (count < 0 || static_cast<size_t>(count) * width > (size_t)(_size - _position)) {
+            throw std::runtime_error("Invalid array size");
+        }
+        return count;
+    }
+
+    void ReadArray(void* data, size_t count, size_t width) {
+        if (width == 4) {
+            byteorder::Swap32(data, &_buffer[_position], count);
+        }
+        else {
+            byteorder::Swap64(data, &_buffer[_position], count);
+        }
+        _position += count * width;
+    }
+
 private:
-    std::vector<char> _buffer;
+    const char* _buffer;
+    int _size;
     int _position;
 };
 
+// Reliable messages go over the TCP stream. Unreliable ones go over the UDP
+// channel when one is up, where only the newest datagram per message id is
+// kept, and fall back to TCP otherwise.
+enum class Delivery { Reliable, Unreliable };
+
 struct Message {
+    virtual ~Message() = default;
+
     virtual void encode(Encoder& encoder) = 0;
     virtual void decode(Decoder& decoder) = 0;
+
+    // Restores default field values for reuse, keeping string capacity
+    virtual void reset() = 0;
+
+    virtual Delivery delivery() const { return Delivery::Reliable; }
+
+    // Requests are answered with exactly one reply or error message
+    virtual bool expectsReply() const { return false; }
 };
 
 struct HelloMessage : public Message
@@ -147,6 +309,16 @@ struct HelloMessage : public Message
     bool solved;
     float test;
 
+    virtual void reset() override {
+        text.clear();
+        addA = 0;
+        addB = 0;
+        solved = false;
+        test = 0;
+    }
+
+    virtual bool expectsReply() const override { return true; }
+
     virtual void encode(Encoder& encoder) override {
         encoder.WriteByte(constants::hello_id);
         encoder.WriteString(text);
@@ -172,6 +344,13 @@ struct ReplyMessage : public Message
     bool solved;
     float test;
 
+    virtual void reset() override {
+        text.clear();
+        result = 0;
+        solved = false;
+        test = 0;
+    }
+
     virtual void encode(Encoder& encoder) override {
         encoder.WriteByte(constants::reply_id);
         encoder.WriteString(text);
@@ -188,4 +367,115 @@ struct ReplyMessage : public Message
     }
 };
 
+// Header frame for a raw byte stream. The frame is followed directly on the
+// socket by exactly `length` bytes that are not part of any frame, so they can
+// be moved with sendfile/splice instead of going through an Encoder.
+struct BlobMessage : public Message
+{
+    std::string name;
+    int64_t length;
+
+    virtual void reset() override {
+        name.clear();
+        length = 0;
+    }
+
+    virtual void encode(Encoder& encoder) override {
+        encoder.WriteByte(constants::blob_id);
+        encoder.WriteString(name);
+        encoder.WriteLong(length);
+    }
+
+    virtual void decode(Decoder& decoder) override {
+        decoder.ReadString(&name);
+        decoder.ReadLong(&length);
+    }
+};
+
+struct ErrorMessage : public Message
+{
+    short code;
+    std::string text;
+
+    virtual void reset() override {
+        code = constants::error_generic;
+        text.clear();
+    }
+
+    virtual void encode(Encoder& encoder) override {
+        encoder.WriteByte(constants::error_id);
+        encoder.WriteShort(code);
+        encoder.WriteString(text);
+    }
+
+    virtual void decode(Decoder& decoder) override {
+        decoder.ReadShort(&code);
+        decoder.ReadString(&text);
+    }
+};
+
+// Sent by the server over TCP after accept, then echoed by the client over
+// UDP so the server learns the client's datagram address
+struct UdpSessionMessage : public Message
+{
+    int session;
+
+    virtual void reset() override {
+        session = 0;
+    }
+
+    virtual void encode(Encoder& encoder) override {
+        encoder.WriteByte(constants::udp_session_id);
+        encoder.WriteInt(session);
+    }
+
+    virtual void decode(Decoder& decoder) override {
+        decoder.ReadInt(&session);
+    }
+};
+
+// High rate state update, only the newest one matters
+struct StateMessage : public Message
+{
+    int entity;
+    std::vector<float> values;
+
+    virtual void reset() override {
+        entity = 0;
+        values.clear();
+    }
+
+    virtual Delivery delivery() const override { return Delivery::Unreliable; }
+
+    virtual void encode(Encoder& encoder) override {
+        encoder.WriteByte(constants::state_id);
+        encoder.WriteInt(entity);
+        encoder.WriteFloatArray(values);
+    }
+
+    virtual void decode(Decoder& decoder) override {
+        decoder.ReadInt(&entity);
+        decoder.ReadFloatArray(&values);
+    }
+};
+
+// Asks the peer to checksum its frames; the reply says whether it will
+struct IntegrityMessage : public Message
+{
+    bool checksums;
+
+    virtual void reset() override {
+        checksums = false;
+    }
+
+    virtual void encode(Encoder& encoder) override {
+        encoder.WriteByte(constants::integrity_id);
+        encoder.WriteBoolean(checksums);
+    }
+
+    virtual void decode(Decoder& decoder) override {
+        decoder.ReadBoolean(&checksums);
+    }
+};
+
 #endif
@@ -0,0 +1,92 @@
+#ifndef OUTBOUND_HPP
+#define OUTBOUND_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <ostream>
+
+// Priority class of an outbound frame, chosen by its message id
+enum class Priority : unsigned char { Control, Interactive, Bulk };
+
+// Per-connection outbound frames, queued in one lane per priority class.
+// Lanes are switched only at frame boundaries: the control lane always goes
+// first, so a control frame waits for at most the frame already on the
+// wire; the other lanes share the rest by deficit round robin, each getting
+// `weight` quanta of bytes per round.
+//
+// A peer that keeps sending but stops reading would make the queue grow
+// without end, so Push refuses frames past a byte limit across all lanes
+// and the connection is dropped.
+class OutboundQueue
+{
+public:
+    static constexpr size_t lane_count = 3;
+
+    // bytes a lane may send per round and unit of weight; a larger frame
+    // waits until its lane has saved up enough rounds
+    static constexpr int64_t quantum = 8192;
+
+    static constexpr size_t default_limit = 4 << 20;
+
+    enum class Result { Drained, Blocked, Error };
+
+    struct LaneStats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        size_t   maxQueued = 0; // bytes
+    };
+
+    OutboundQueue();
+
+    // Frames in different lanes may overtake each other, so only message ids
+    // whose order against other replies carries no meaning belong in a
+    // lane of their own
+    void SetPriority(unsigned char messageId, Priority priority) { _priorities[messageId] = priority; }
+    void SetWeight(Priority priority, int weight);
+    void SetLimit(size_t bytes) { _limit = bytes; }
+
+    Priority priority(unsigned char messageId) const { return _priorities[messageId]; }
+
+    // Queues a complete frame (length prefix included); false if that would
+    // take the queue past its limit
+    bool Push(const char* frame, size_t size);
+
+    // Writes queued frames until the queue is empty or the socket would
+    // block; on Error errno holds the send error
+    Result Flush(int socket);
+
+    // Drops queued frames of a closed connection, keeping lane capacity
+    void Clear();
+
+    bool empty() const { return _queued == 0; }
+    size_t queued() const { return _queued; }
+
+    void Print(std::ostream& out) const;
+
+private:
+    struct Lane {
+        std::vector<char> bytes;   // queued frames back to back
+        size_t   head = 0;         // start of the oldest frame
+        int      weight = 1;
+        int64_t  deficit = 0;
+        LaneStats stats;
+
+        bool empty() const { return head == bytes.size(); }
+    };
+
+    static size_t FrameSize(const Lane& lane);
+    Lane* Pick();
+
+    std::array<Lane, lane_count> _lanes;
+    std::array<Priority, 256> _priorities;
+    size_t _cursor;    // lane currently served by round robin
+    Lane*  _active;    // lane of a partially written frame
+    size_t _written;   // bytes of the active frame already sent
+    size_t _queued;
+    size_t _limit;
+    uint64_t _overflows; // connections dropped at the limit
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Per-thread free list of message objects. Acquired messages are reset()
+// but keep their string capacity, so steady-state decoding reuses the same
+// allocations frame after frame. Up to max_free objects are kept per type.
+template <typename T, size_t max_free = 64>
+class MessagePool
+{
+public:
+    // Owns an acquired message and returns it to the pool on destruction
+    class Handle
+    {
+    public:
+        explicit Handle(T* message) : _message(message) {}
+        ~Handle() { if (_message) Release(_message); }
+
+        Handle(Handle&& other) noexcept : _message(other._message) { other._message = nullptr; }
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        Handle& operator=(Handle&&) = delete;
+
+        T* operator->() const { return _message; }
+        T& operator*() const { return *_message; }
+
+    private:
+        T* _message;
+    };
+
+    static Handle Acquire() {
+        std::vector<T*>& free = FreeList();
+        if (free.empty()) {
+            T* message = new T();
+            message->reset();
+            return Handle(message);
+        }
+
+        T* message = free.back();
+        free.pop_back();
+        message->reset();
+        return Handle(message);
+    }
+
+private:
+    static void Release(T* message) {
+        std::vector<T*>& free = FreeList();
+        if (free.size() >= max_free) {
+            delete message;
+            return;
+        }
+        free.push_back(message);
+    }
+
+    // Deletes the pooled objects when the thread exits
+    struct FreeListOwner
+    {
+        std::vector<T*> list;
+
+        FreeListOwner() { list.reserve(max_free); }
+        ~FreeListOwner() {
+            for (T* message : list) {
+                delete message;
+            }
+        }
+    };
+
+    static std::vector<T*>& FreeList() {
+        thread_local FreeListOwner owner;
+        return owner.list;
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Caches encoded reply frames of deterministic handlers, keyed by the
+// request payload. A hit is sent as is, skipping decode, handler and encode.
+// Caching is opt-in per message id; a cached handler must answer every
+// request with exactly one reply that depends on nothing but the payload.
+//
+// Entries are spread over independently locked shards, each bounded to its
+// share of the byte capacity and evicting least recently used entries.
+class ResponseCache
+{
+public:
+    static constexpr size_t shard_count = 16;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Request payload (id byte onwards) and whether replies are sealed with
+    // a checksum trailer, so both frame variants can be cached side by side
+    struct Key {
+        uint64_t    hash = 0;
+        const char* data = nullptr;
+        size_t      size = 0;
+        bool        sealed = false;
+    };
+
+    ResponseCache() : _shardCapacity(0) { _enabled.fill(false); }
+
+    // Total bytes of keys and frames to hold, 0 disables the cache
+    void SetCapacity(size_t bytes);
+    void Enable(unsigned char messageId) { _enabled[messageId] = true; }
+
+    bool enabled(unsigned char messageId) const { return _shardCapacity > 0 && _enabled[messageId]; }
+
+    static Key MakeKey(const char* data, size_t size, bool sealed);
+
+    // Copies a cached frame into frame, reusing its capacity
+    bool Lookup(const Key& key, std::vector<char>& frame);
+    void Insert(const Key& key, const char* frame, size_t size);
+
+    void Clear();
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t    hash;
+        bool        sealed;
+        std::string key;
+        std::string frame;
+    };
+
+    struct Shard {
+        mutable std::mutex lock;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        Stats  stats;
+    };
+
+    Shard& ShardFor(uint64_t hash) { return _shards[hash % shard_count]; }
+    static void Erase(Shard& shard, std::list<Entry>::iterator it);
+
+    std::array<Shard, shard_count> _shards;
+    std::array<bool, 256> _enabled;
+    size_t _shardCapacity;
+};
+
+#endif
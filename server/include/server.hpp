@@ -15,29 +15,135 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <string>
+#include <cstdint>
+#include <vector>
 
-// Forward decleration
-class Message;
+#include <constants.hpp>
+#include <capture.hpp>
+#include <arena.hpp>
+#include <admission.hpp>
+#include <response_cache.hpp>
+#include <outbound.hpp>
+#include <datagram.hpp>
+#include <tcp_stats.hpp>
+#include <message.hpp>
 
 class Server
 {
 public:
-    Server(int port);
+    // With a handoff path the server first tries to take the listening
+    // socket (and with takeConnection the live connection) over from a
+    // running instance, then offers the same handoff to the next one.
+    Server(int port, const std::string& handoffPath = "", bool takeConnection = false);
     ~Server(); // server class destructor
 
     bool connected() const { return _connected; }
 
+    // Serves a pending hot restart request, and ends draining on timeout
+    void PollHandoff();
+
+    // Handed off and done draining, the process can exit
+    bool finished() const { return _finished; }
+
     void AcceptConnection();
     void HandleConnection();
     void Send(Message& message);
+    void FlushDatagrams() { _udp.Flush(); }
     void Disconnect(const std::string& reason);
-    void SendError(std::string text);
+    void SendError(const std::string& text, short code = constants::error_generic);
+
+    // Rate limits and overload shedding applied before frames are decoded
+    AdmissionControl& admission() { return _admission; }
+
+    // Priority class and lane weights of outbound frames
+    OutboundQueue& outbound() { return _outbound; }
+
+    // Encoded replies of deterministic handlers, opt-in per message id
+    ResponseCache& responseCache() { return _responseCache; }
+
+    // Zero-copy bulk transfer: a BlobMessage frame followed by the raw bytes
+    bool SendFile(const std::string& path);
+    bool SendFile(int fd, off_t offset, int64_t length, const std::string& name);
+    bool SendBlob(const std::string& name, const char* data, size_t length);
+
+    // Admission, capture and per-connection TCP statistics
+    void PrintStats(std::ostream& out) const;
+
+    // Record every inbound frame to a log for the replay tool
+    bool StartCapture(const std::string& path);
+    void StopCapture() { _capture.Close(); }
+
+private:
+    void Listen(int port);
+    bool TakeOver(bool takeConnection);
+    void OpenHandoff();
+    void HandOff(int peer);
+
+    void ReceiveDatagrams();
+    void ReceiveFrame();
+    void Dispatch(unsigned char packetId, Decoder& decoder);
+
+    void SendFrame(const char* frame, int size);
+    bool FlushOutbound();
+    bool DrainOutbound();
+    bool SendBlobHeader(const std::string& name, int64_t length);
+    bool WriteAll(const char* data, size_t size);
+    bool WaitWritable();
+    bool EnableZeroCopy();
+    bool WaitZeroCopy();
 
 private:
     int _socket;
     bool _connected;
     int _currentSize;
     int _serverSocket;
+
+    // pending frame, read over as many ticks as it takes to arrive
+    char*   _frame;
+    int     _received;
+    int64_t _frameArrivedNs; // realtime, 0 without a kernel timestamp (latency unknown)
+
+    // CRC32C frame trailers: whether we seal outbound frames, whether the
+    // peer negotiated to always send them, and if the pending frame has one
+    bool _checksums;
+    bool _requireChecksums;
+    bool _currentChecksum;
+
+    // frames waiting for the socket, drained by priority
+    OutboundQueue _outbound;
+
+    // MSG_ZEROCOPY state for the current connection
+    bool _zeroCopy;
+    uint32_t _zeroCopySent;
+    uint32_t _zeroCopyDone;
+
+    CaptureWriter _capture;
+
+    // reused every frame so the steady state does not allocate
+    Arena   _arena;
+    Encoder _encoder;
+
+    AdmissionControl _admission;
+
+    // the next reply frame sent is stored under _cacheKey while a cacheable
+    // request is being handled; _cachedFrame is reused for hits
+    ResponseCache      _responseCache;
+    ResponseCache::Key _cacheKey;
+    bool               _cachePending;
+    std::vector<char>  _cachedFrame;
+
+    // optional UDP channel for Delivery::Unreliable messages
+    DatagramChannel _udp;
+
+    // kernel TCP_INFO and queue depth samples per connection
+    TcpSampler _tcpStats;
+
+    // hot restart
+    std::string _handoffPath;
+    int         _handoffSocket;
+    bool        _draining;
+    bool        _finished;
+    int64_t     _drainDeadline;
 };
 
 #endif
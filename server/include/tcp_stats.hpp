@@ -0,0 +1,75 @@
+#ifndef TCP_STATS_HPP
+#define TCP_STATS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <ostream>
+#include <netinet/in.h>
+
+// Kernel view of one connection, read with TCP_INFO and SIOCOUTQ/SIOCINQ
+struct TcpSample {
+    uint32_t rttUs = 0;
+    uint32_t rttVarUs = 0;
+    uint32_t retransmits = 0;   // total retransmitted segments
+    uint32_t cwnd = 0;          // congestion window, segments
+    uint32_t unacked = 0;       // segments in flight
+    uint32_t sendQueue = 0;     // bytes written but not yet acked
+    uint32_t receiveQueue = 0;  // bytes received but not yet read
+};
+
+struct TcpConnectionStats {
+    sockaddr_in peer{};
+    int         fd = -1;        // -1 once closed
+    uint64_t    samples = 0;
+    TcpSample   last;
+    uint32_t    maxRttUs = 0;
+    uint32_t    maxSendQueue = 0;
+    uint64_t    rttSumUs = 0;
+};
+
+// Periodically samples every tracked connection. Stats of closed
+// connections are kept (up to max_connections in total) so a peer that
+// caused trouble still shows up in the worst-offender lists afterwards.
+class TcpSampler
+{
+public:
+    static constexpr size_t max_connections = 64;
+
+    explicit TcpSampler(int64_t intervalNs = 1000000000LL) : _intervalNs(intervalNs), _lastPoll(0) {}
+
+    void Track(int fd, const sockaddr_in& peer);
+
+    // Takes a final sample and keeps the stats of a closing connection
+    void Untrack(int fd);
+
+    // Samples all open connections if the interval has passed
+    void Poll(int64_t nowNs);
+
+    struct Aggregate {
+        size_t   open = 0;
+        uint32_t avgRttUs = 0;
+        uint32_t maxRttUs = 0;
+        uint64_t retransmits = 0;
+        uint64_t sendQueue = 0;
+        uint64_t receiveQueue = 0;
+    };
+    Aggregate aggregate() const;
+
+    // Highest current send queue / highest peak RTT first
+    std::vector<const TcpConnectionStats*> WorstBySendQueue(size_t count) const;
+    std::vector<const TcpConnectionStats*> WorstByRtt(size_t count) const;
+
+    void Print(std::ostream& out, size_t worst = 5) const;
+
+private:
+    static bool Sample(int fd, TcpSample* sample);
+    void Record(TcpConnectionStats& stats);
+
+private:
+    int64_t _intervalNs;
+    int64_t _lastPoll;
+    std::vector<TcpConnectionStats> _connections;
+};
+
+#endif
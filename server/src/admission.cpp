@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <admission.hpp>
+
+void TokenBucket::Configure(double rate, double burst)
+{
+    _rate = rate;
+    _burst = std::max(burst, 1.0);
+    _tokens = _burst;
+}
+
+bool TokenBucket::TryTake(int64_t nowNs)
+{
+    if (_rate <= 0) {
+        return true;
+    }
+
+    if (nowNs > _last) {
+        _tokens = std::min(_burst, _tokens + (nowNs - _last) * _rate / 1e9);
+        _last = nowNs;
+    }
+
+    if (_tokens < 1) {
+        return false;
+    }
+    _tokens -= 1;
+    return true;
+}
+
+AdmissionControl::AdmissionControl()
+: _targetNs(0), _intervalNs(0), _aboveSince(0), _shedding(false)
+{}
+
+void AdmissionControl::SetConnectionLimit(double rate, double burst)
+{
+    _connection.Configure(rate, burst);
+}
+
+void AdmissionControl::SetMessageLimit(unsigned char messageId, double rate, double burst)
+{
+    _messages[messageId].Configure(rate, burst);
+}
+
+void AdmissionControl::SetQueueLatencyTarget(int64_t targetNs, int64_t intervalNs)
+{
+    _targetNs = targetNs;
+    _intervalNs = intervalNs;
+}
+
+void AdmissionControl::Reset(int64_t nowNs)
+{
+    _connection.Refill(nowNs);
+    for (TokenBucket& bucket : _messages) {
+        bucket.Refill(nowNs);
+    }
+    _aboveSince = 0;
+    _shedding = false;
+}
+
+AdmissionControl::Verdict AdmissionControl::Admit(unsigned char messageId, int64_t queueLatencyNs, int64_t nowNs)
+{
+    if (_targetNs > 0) {
+        // an unknown latency follows the current verdict without moving it
+        if (queueLatencyNs >= 0) {
+            if (queueLatencyNs <= _targetNs) {
+                _aboveSince = 0;
+                _shedding = false;
+            }
+            else if (_aboveSince == 0) {
+                _aboveSince = nowNs;
+            }
+            else if (nowNs - _aboveSince >= _intervalNs) {
+                _shedding = true;
+            }
+        }
+
+        if (_shedding) {
+            _stats.shed++;
+            return Verdict::Overloaded;
+        }
+    }
+
+    if (!_connection.TryTake(nowNs) || !_messages[messageId].TryTake(nowNs)) {
+        _stats.rateLimited++;
+        return Verdict::RateLimited;
+    }
+
+    _stats.admitted++;
+    return Verdict::Admit;
+}
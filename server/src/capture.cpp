@@ -0,0 +1,227 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <capture.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+// The file is extended and remapped in steps of this size
+static constexpr size_t capture_grow_size = 64 << 20;
+
+static int64_t MonotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CaptureWriter::CaptureWriter()
+: _fd(-1), _map(nullptr), _mapSize(0), _used(0), _records(0), _start(0)
+{}
+
+CaptureWriter::~CaptureWriter()
+{
+    Close();
+}
+
+bool CaptureWriter::Open(const std::string& path)
+{
+    Close();
+
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd == -1) {
+        std::cerr << "Failed to open capture log " << path << ": " << errno << std::endl;
+        return false;
+    }
+
+    // another writer (a server still draining after a hot restart) has the
+    // log mapped, truncating it under that mapping would corrupt both logs
+    if (flock(_fd, LOCK_EX | LOCK_NB) == -1 || ftruncate(_fd, 0) == -1) {
+        std::cerr << "Capture log " << path << " is in use by another process" << std::endl;
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    _used = 0;
+    _records = 0;
+    if (!Reserve(capture::header_size)) {
+        Close();
+        return false;
+    }
+
+    memcpy(_map, capture::magic, sizeof(capture::magic));
+    memcpy(_map + 4, &capture::version, sizeof(uint32_t));
+    _used = capture::header_size;
+    _start = MonotonicNs();
+
+    std::cout << "Capturing inbound frames to " << path << std::endl;
+    return true;
+}
+
+void CaptureWriter::Append(const char* frame, uint32_t size)
+{
+    if (_fd == -1 || size == 0 || size == capture::connection_marker) {
+        return;
+    }
+
+    Write(frame, size, size);
+    _records++;
+}
+
+void CaptureWriter::MarkConnection()
+{
+    if (_fd == -1) {
+        return;
+    }
+
+    Write(nullptr, 0, capture::connection_marker);
+}
+
+void CaptureWriter::Write(const char* frame, uint32_t size, uint32_t recordSize)
+{
+    if (!Reserve(capture::record_header_size + size)) {
+        Close();
+        return;
+    }
+
+    uint64_t timestamp = MonotonicNs() - _start;
+    char* record = _map + _used;
+    memcpy(record, &timestamp, sizeof(uint64_t));
+    memcpy(record + sizeof(uint64_t), &recordSize, sizeof(uint32_t));
+    if (size > 0) {
+        memcpy(record + capture::record_header_size, frame, size);
+    }
+
+    _used += capture::record_header_size + size;
+}
+
+void CaptureWriter::Close()
+{
+    if (_fd == -1) {
+        return;
+    }
+
+    if (_map) {
+        munmap(_map, _mapSize);
+        _map = nullptr;
+        _mapSize = 0;
+    }
+
+    // drop the unused tail of the last grow step
+    if (ftruncate(_fd, _used) == -1) {
+        std::cerr << "Failed to truncate capture log: " << errno << std::endl;
+    }
+    close(_fd);
+    _fd = -1;
+
+    std::cout << "Capture closed: " << _records << " frames, " << _used << " bytes" << std::endl;
+}
+
+bool CaptureWriter::Reserve(size_t size)
+{
+    if (_used + size <= _mapSize) {
+        return true;
+    }
+
+    size_t newSize = _mapSize + capture_grow_size;
+    while (newSize < _used + size) {
+        newSize += capture_grow_size;
+    }
+
+    if (ftruncate(_fd, newSize) == -1) {
+        std::cerr << "Failed to grow capture log: " << errno << std::endl;
+        return false;
+    }
+
+    void* map = _map
+        ? mremap(_map, _mapSize, newSize, MREMAP_MAYMOVE)
+        : mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Failed to map capture log: " << errno << std::endl;
+        return false;
+    }
+
+    _map = static_cast<char*>(map);
+    _mapSize = newSize;
+    return true;
+}
+
+CaptureReader::CaptureReader()
+: _map(nullptr), _mapSize(0), _position(capture::header_size)
+{}
+
+CaptureReader::~CaptureReader()
+{
+    if (_map) {
+        munmap(_map, _mapSize);
+    }
+}
+
+bool CaptureReader::Open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Failed to open capture log " << path << ": " << errno << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < capture::header_size) {
+        std::cerr << "Invalid capture log: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Failed to map capture log: " << errno << std::endl;
+        return false;
+    }
+
+    _map = static_cast<char*>(map);
+    _mapSize = st.st_size;
+    _position = capture::header_size;
+
+    uint32_t version;
+    memcpy(&version, _map + 4, sizeof(uint32_t));
+    if (memcmp(_map, capture::magic, sizeof(capture::magic)) != 0 || version < capture::min_version ||
+        version > capture::version) {
+        std::cerr << "Unsupported capture log: " << path << std::endl;
+        return false;
+    }
+
+    madvise(_map, _mapSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool CaptureReader::Next(uint64_t* timestamp, const char** frame, uint32_t* size)
+{
+    if (_position + capture::record_header_size > _mapSize) {
+        return false;
+    }
+
+    const char* record = _map + _position;
+    memcpy(timestamp, record, sizeof(uint64_t));
+    memcpy(size, record + sizeof(uint64_t), sizeof(uint32_t));
+
+    if (*size == capture::connection_marker) {
+        *frame = nullptr;
+        *size = 0;
+        _position += capture::record_header_size;
+        return true;
+    }
+
+    if (*size == 0 || _position + capture::record_header_size + *size > _mapSize) {
+        return false;
+    }
+
+    *frame = record + capture::record_header_size;
+    _position += capture::record_header_size + *size;
+    return true;
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <crc32c.hpp>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Measures the cost of CRC32C frame trailers: checksums 1 GiB of data in
+// frame-sized chunks with the hardware and the portable implementation.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t total_bytes = 1ULL << 30;
+static constexpr size_t buffer_bytes = 64 << 20;
+
+template <typename Function>
+static void Run(const std::string& name, const std::vector<char>& buffer, size_t frame, Function&& crc)
+{
+    uint32_t sink = 0;
+    auto start = Clock::now();
+#if defined(__x86_64__)
+    uint64_t cycles = __rdtsc();
+#endif
+
+    for (size_t done = 0; done < total_bytes; done += buffer.size()) {
+        for (size_t offset = 0; offset < buffer.size(); offset += frame) {
+            sink += crc(buffer.data() + offset, frame);
+        }
+    }
+
+#if defined(__x86_64__)
+    cycles = __rdtsc() - cycles;
+#endif
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::cout << std::left << std::setw(10) << name
+              << std::right << std::setw(8) << frame << " B frames: "
+              << std::fixed << std::setprecision(1) << std::setw(8) << elapsed.count() * 1000 << " ms/GiB, "
+              << std::setprecision(2) << std::setw(6) << total_bytes / elapsed.count() / (1 << 30) << " GiB/s";
+#if defined(__x86_64__)
+    // TSC ticks, which track nominal rather than boosted core cycles
+    std::cout << ", " << std::setprecision(3) << (double)cycles / total_bytes << " ticks/byte";
+#endif
+    std::cout << "  (" << std::hex << sink << std::dec << ")\n";
+}
+
+int main()
+{
+    std::vector<char> buffer(buffer_bytes);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<char>(i * 2654435761u >> 13);
+    }
+
+    for (size_t frame : { 64, 1024, 8192 }) {
+        Run("hardware", buffer, frame, [](const char* data, size_t size) { return crc32c::Compute(data, size); });
+        Run("software", buffer, frame, [](const char* data, size_t size) { return crc32c::ComputeSoftware(data, size); });
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <cstring>
+#include <handoff.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+static bool WaitFor(int socket, short events)
+{
+    pollfd pfd{ socket, events, 0 };
+    int result;
+    do {
+        result = poll(&pfd, 1, handoff::timeout_ms);
+    } while (result == -1 && errno == EINTR);
+    return result > 0 && (pfd.revents & events);
+}
+
+bool handoff::SendFds(int socket, const char* data, size_t size, const int* fds, int count)
+{
+    if (count < 0 || count > max_fds || size == 0) {
+        return false;
+    }
+
+    iovec iov{ const_cast<char*>(data), size };
+    char control[CMSG_SPACE(sizeof(int) * max_fds)]{};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+        cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cm), fds, sizeof(int) * count);
+    }
+
+    if (!WaitFor(socket, POLLOUT)) {
+        return false;
+    }
+    return sendmsg(socket, &msg, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+ssize_t handoff::ReceiveFds(int socket, char* data, size_t size, int* fds, int* count)
+{
+    *count = 0;
+
+    iovec iov{ data, size };
+    char control[CMSG_SPACE(sizeof(int) * max_fds)];
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (!WaitFor(socket, POLLIN)) {
+        return -1;
+    }
+
+    ssize_t result = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (result <= 0) {
+        return -1;
+    }
+
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+            *count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cm), sizeof(int) * *count);
+        }
+    }
+
+    // a truncated descriptor list would leak or misassign sockets
+    if (msg.msg_flags & MSG_CTRUNC) {
+        for (int i = 0; i < *count; i++) {
+            close(fds[i]);
+        }
+        *count = 0;
+        return -1;
+    }
+    return result;
+}
+
+bool handoff::SendByte(int socket, char value)
+{
+    return WaitFor(socket, POLLOUT) && send(socket, &value, 1, MSG_NOSIGNAL) == 1;
+}
+
+bool handoff::ReceiveByte(int socket, char* value)
+{
+    return WaitFor(socket, POLLIN) && recv(socket, value, 1, 0) == 1;
+}
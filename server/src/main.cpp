@@ -2,20 +2,123 @@
 #include <atomic>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <csignal>
+#include <unistd.h>
 
 #include <constants.hpp>
 #include <server.hpp>
 
-int main() {
-    std::atomic<bool> running = true;
+static std::atomic<bool> running = true;
 
-    Server server(constants::server_port);
+static std::atomic<bool> printStats = false;
+
+static void Stop(int) {
+    running = false;
+}
+
+static void RequestStats(int) {
+    printStats = true;
+}
+
+int main(int argc, char** argv) {
+    // let the capture log be finalized on ctrl-c
+    std::signal(SIGINT, Stop);
+    std::signal(SIGTERM, Stop);
+
+    // kill -USR1 <pid> prints the server's stats
+    std::signal(SIGUSR1, RequestStats);
+
+    // a peer closing mid transfer must not kill the server; sendfile takes
+    // no MSG_NOSIGNAL, so EPIPE is handled where it is returned instead
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int port = constants::server_port;
+    std::string capturePath;
+    std::string handoffPath;
+    bool takeConnection = false;
+    double rate = 0;
+    int64_t maxQueueMs = 0;
+    size_t cacheMb = 0;
+    size_t maxOutboundKb = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        }
+        else if (arg == "--capture" && i + 1 < argc) {
+            capturePath = argv[++i];
+        }
+        else if (arg == "--rate" && i + 1 < argc) {
+            rate = std::stod(argv[++i]);
+        }
+        else if (arg == "--max-queue-ms" && i + 1 < argc) {
+            maxQueueMs = std::stoll(argv[++i]);
+        }
+        else if (arg == "--cache-mb" && i + 1 < argc) {
+            cacheMb = std::stoul(argv[++i]);
+        }
+        else if (arg == "--max-outbound-kb" && i + 1 < argc) {
+            maxOutboundKb = std::stoul(argv[++i]);
+        }
+        else if (arg == "--handoff" && i + 1 < argc) {
+            handoffPath = argv[++i];
+        }
+        else if (arg == "--take-connection") {
+            takeConnection = true;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--port <port>] [--capture <log>] [--rate <frames/s>] [--max-queue-ms <ms>] [--cache-mb <MiB>] [--max-outbound-kb <KiB>]"
+                      << " [--handoff <unix socket> [--take-connection]]" << std::endl;
+            return -1;
+        }
+    }
+
+    // with --handoff a running server on the same path hands its sockets over
+    Server server(port, handoffPath, takeConnection);
+
+    // the server we took over keeps writing its log while it drains, so
+    // this one records to a log of its own
+    if (!capturePath.empty() && !server.StartCapture(capturePath)) {
+        if (handoffPath.empty() || !server.StartCapture(capturePath + "." + std::to_string(getpid()))) {
+            return -1;
+        }
+    }
+
+    // frames per second per connection, with one second of burst
+    if (rate > 0) {
+        server.admission().SetConnectionLimit(rate, rate);
+    }
+
+    // shed once frames wait longer than this for 100 ms straight
+    if (maxQueueMs > 0) {
+        server.admission().SetQueueLatencyTarget(maxQueueMs * 1000000, 100000000);
+    }
+
+    // unsent replies a connection may pile up before it is dropped
+    if (maxOutboundKb > 0) {
+        server.outbound().SetLimit(maxOutboundKb << 10);
+    }
+
+    // hello replies depend only on the request, so repeats are served from cache
+    if (cacheMb > 0) {
+        server.responseCache().SetCapacity(cacheMb << 20);
+        server.responseCache().Enable(constants::hello_id);
+    }
 
     // 50 hz tick loop (20 ms per tick)
     const auto tick = std::chrono::milliseconds(20);
 
-    while (running)
+    while (running && !server.finished())
     {
+        // Hot restart
+        server.PollHandoff();
+
+        if (printStats.exchange(false)) {
+            server.PrintStats(std::cout);
+        }
+
         // Networking
         if (!server.connected()) {
             server.AcceptConnection();
@@ -0,0 +1,153 @@
+#include <cstring>
+#include <algorithm>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+
+#include <constants.hpp>
+#include <outbound.hpp>
+
+static const char* lane_names[OutboundQueue::lane_count] = { "control", "interactive", "bulk" };
+
+OutboundQueue::OutboundQueue()
+: _cursor(1), _active(nullptr), _written(0), _queued(0), _limit(default_limit), _overflows(0)
+{
+    _priorities.fill(Priority::Interactive);
+
+    // Error replies answer requests in order and integrity replies switch
+    // sealing at an exact point in the stream, so both stay in the lane of
+    // the replies around them. The session token is ordered against nothing.
+    SetPriority(constants::udp_session_id, Priority::Control);
+    SetPriority(constants::blob_id, Priority::Bulk);
+
+    SetWeight(Priority::Interactive, 4);
+    SetWeight(Priority::Bulk, 1);
+}
+
+void OutboundQueue::SetWeight(Priority priority, int weight)
+{
+    _lanes[(size_t)priority].weight = std::max(weight, 1);
+}
+
+bool OutboundQueue::Push(const char* frame, size_t size)
+{
+    if (_queued + size > _limit) {
+        _overflows++;
+        return false;
+    }
+
+    Lane& lane = _lanes[(size_t)_priorities[(unsigned char)frame[4]]];
+
+    // reclaim sent bytes once they make up most of the buffer
+    if (lane.head > 0 && lane.head >= lane.bytes.size() / 2) {
+        lane.bytes.erase(lane.bytes.begin(), lane.bytes.begin() + lane.head);
+        lane.head = 0;
+    }
+
+    lane.bytes.insert(lane.bytes.end(), frame, frame + size);
+    lane.stats.maxQueued = std::max(lane.stats.maxQueued, lane.bytes.size() - lane.head);
+    _queued += size;
+    return true;
+}
+
+size_t OutboundQueue::FrameSize(const Lane& lane)
+{
+    int length;
+    memcpy(&length, lane.bytes.data() + lane.head, sizeof(int));
+    return ntohl(length) & ~constants::checksum_flag;
+}
+
+OutboundQueue::Lane* OutboundQueue::Pick()
+{
+    if (!_lanes[0].empty()) {
+        return &_lanes[0];
+    }
+    if (_queued == 0) {
+        return nullptr;
+    }
+
+    // some lane past control has frames, so this ends within a few rounds
+    while (true) {
+        Lane& lane = _lanes[_cursor];
+        if (!lane.empty()) {
+            size_t size = FrameSize(lane);
+            if (lane.deficit >= (int64_t)size) {
+                lane.deficit -= size;
+                return &lane;
+            }
+        }
+        else {
+            // an idle lane does not save up credit
+            lane.deficit = 0;
+        }
+
+        _cursor = _cursor + 1 < lane_count ? _cursor + 1 : 1;
+        if (!_lanes[_cursor].empty()) {
+            _lanes[_cursor].deficit += quantum * _lanes[_cursor].weight;
+        }
+    }
+}
+
+OutboundQueue::Result OutboundQueue::Flush(int socket)
+{
+    while (true) {
+        // finish a partially written frame before switching lanes
+        if (!_active) {
+            _active = Pick();
+            _written = 0;
+            if (!_active) {
+                return Result::Drained;
+            }
+        }
+
+        Lane& lane = *_active;
+        size_t size = FrameSize(lane);
+        const char* data = lane.bytes.data() + lane.head + _written;
+
+        ssize_t result = send(socket, data, size - _written, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EWOULDBLOCK ? Result::Blocked : Result::Error;
+        }
+
+        _written += result;
+        if (_written < size) {
+            continue;
+        }
+
+        lane.head += size;
+        lane.stats.frames++;
+        lane.stats.bytes += size;
+        _queued -= size;
+        if (lane.empty()) {
+            lane.bytes.clear();
+            lane.head = 0;
+        }
+        _active = nullptr;
+    }
+}
+
+void OutboundQueue::Clear()
+{
+    for (Lane& lane : _lanes) {
+        lane.bytes.clear();
+        lane.head = 0;
+        lane.deficit = 0;
+    }
+    _active = nullptr;
+    _written = 0;
+    _queued = 0;
+}
+
+void OutboundQueue::Print(std::ostream& out) const
+{
+    out << "Outbound (limit " << _limit << " bytes, " << _overflows << " overflows):";
+    for (size_t i = 0; i < lane_count; i++) {
+        const LaneStats& stats = _lanes[i].stats;
+        out << " " << lane_names[i] << " " << stats.frames << " frames/" << stats.bytes
+            << " bytes (max queued " << stats.maxQueued << ")" << (i + 1 < lane_count ? "," : "");
+    }
+    out << "\n";
+}
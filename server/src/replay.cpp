@@ -0,0 +1,259 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+
+#include <constants.hpp>
+#include <capture.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+// Re-drives a capture log (see `server --capture`) against a server and
+// reports request/reply latency. Replies are matched to requests in order,
+// so only frames whose id has a reply (hello_id) are timed; an error reply
+// (rejected by admission control) also answers a request. Each captured
+// connection is replayed on a connection of its own, so per-connection state
+// such as the checksum handshake starts over as it did when recorded.
+
+using Clock = std::chrono::steady_clock;
+
+// How long to wait for outstanding replies after the last frame is sent
+static constexpr auto drain_timeout = std::chrono::seconds(5);
+
+static void Usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " <log> [--speed <factor> | --max] [--loops <n>] [--host <ip>] [--port <port>]" << std::endl;
+}
+
+static bool SendAll(int socket, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t result = send(socket, data, size, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "send failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        Usage(argv[0]);
+        return -1;
+    }
+
+    std::string path = argv[1];
+    std::string host = "127.0.0.1";
+    int port = constants::server_port;
+    double speed = 1.0; // 0 = as fast as possible
+    int loops = 1;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--speed" && i + 1 < argc) {
+            speed = std::stod(argv[++i]);
+        }
+        else if (arg == "--max") {
+            speed = 0;
+        }
+        else if (arg == "--loops" && i + 1 < argc) {
+            loops = std::stoi(argv[++i]);
+        }
+        else if (arg == "--host" && i + 1 < argc) {
+            host = argv[++i];
+        }
+        else if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        }
+        else {
+            Usage(argv[0]);
+            return -1;
+        }
+    }
+
+    CaptureReader reader;
+    if (!reader.Open(path)) {
+        return -1;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "Invalid address" << std::endl;
+        return -1;
+    }
+
+    int sock = -1;
+    std::deque<Clock::time_point> outstanding;
+    std::vector<double> latencies; // microseconds
+    std::vector<char> inbox;
+    uint64_t sent = 0;
+    uint64_t bytes = 0;
+    uint64_t rejected = 0;
+    uint64_t connections = 0;
+    uint64_t missing = 0;
+
+    auto connect_server = [&]() -> bool {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == -1 || connect(sock, (sockaddr*)&addr, sizeof(addr)) == -1) {
+            std::cerr << "Connect failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+        connections++;
+        return true;
+    };
+
+    // Reads whatever replies have arrived within timeoutMs and times them
+    auto poll_replies = [&](int timeoutMs) -> bool {
+        pollfd pfd{ sock, POLLIN, 0 };
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            return true;
+        }
+
+        char chunk[65536];
+        ssize_t result = recv(sock, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (result == 0 || (result == -1 && errno != EWOULDBLOCK && errno != EINTR)) {
+            std::cerr << "Server closed the connection" << std::endl;
+            return false;
+        }
+        if (result > 0) {
+            inbox.insert(inbox.end(), chunk, chunk + result);
+        }
+
+        auto now = Clock::now();
+        size_t offset = 0;
+        while (inbox.size() - offset >= sizeof(int)) {
+            int length;
+            memcpy(&length, inbox.data() + offset, sizeof(int));
+            length = ntohl(length) & ~constants::checksum_flag;
+            if (length <= (int)sizeof(int)) {
+                std::cerr << "Invalid reply frame" << std::endl;
+                return false;
+            }
+            if (inbox.size() - offset < (size_t)length) {
+                break;
+            }
+
+            unsigned char id = inbox[offset + sizeof(int)];
+            if (id == constants::error_id) {
+                rejected++;
+            }
+            if ((id == constants::reply_id || id == constants::error_id) && !outstanding.empty()) {
+                std::chrono::duration<double, std::micro> latency = now - outstanding.front();
+                latencies.push_back(latency.count());
+                outstanding.pop_front();
+            }
+            offset += length;
+        }
+        inbox.erase(inbox.begin(), inbox.begin() + offset);
+        return true;
+    };
+
+    // Waits for the replies still owed on this connection, then closes it
+    auto disconnect_server = [&]() -> bool {
+        bool ok = true;
+        auto sendEnd = Clock::now();
+        while (ok && !outstanding.empty() && Clock::now() - sendEnd < drain_timeout) {
+            ok = poll_replies(10);
+        }
+        missing += outstanding.size();
+        outstanding.clear();
+        inbox.clear();
+        close(sock);
+        sock = -1;
+        return ok;
+    };
+
+    auto start = Clock::now();
+    bool ok = true;
+
+    for (int loop = 0; loop < loops && ok; loop++) {
+        reader.Rewind();
+        auto loopStart = Clock::now();
+
+        uint64_t timestamp;
+        const char* frame;
+        uint32_t size;
+        while (ok && reader.Next(&timestamp, &frame, &size)) {
+            // the capture saw a new connection here
+            if (!frame) {
+                if (sock != -1) {
+                    ok = disconnect_server();
+                }
+                continue;
+            }
+            if (sock == -1 && !connect_server()) {
+                ok = false;
+                break;
+            }
+
+            if (speed > 0) {
+                auto due = loopStart + std::chrono::nanoseconds((int64_t)(timestamp / speed));
+
+                // service replies while waiting for the frame's original time
+                while (ok && Clock::now() < due) {
+                    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now());
+                    ok = poll_replies(std::max<int>(0, wait.count()));
+                }
+            }
+            else {
+                ok = poll_replies(0);
+            }
+
+            if (size > sizeof(int) && (unsigned char)frame[sizeof(int)] == constants::hello_id) {
+                outstanding.push_back(Clock::now());
+            }
+            if (!ok || !SendAll(sock, frame, size)) {
+                ok = false;
+                break;
+            }
+            sent++;
+            bytes += size;
+        }
+    }
+
+    if (sock != -1 && !disconnect_server()) {
+        ok = false;
+    }
+    auto end = Clock::now();
+
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Frames sent:   " << sent << " (" << bytes << " bytes) over " << connections << " connection(s)\n";
+    std::cout << "Elapsed:       " << elapsed.count() << " s\n";
+    std::cout << "Throughput:    " << sent / elapsed.count() << " frames/s\n";
+    std::cout << "Replies:       " << latencies.size() << " (" << rejected << " rejected, " << missing << " missing)\n";
+
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+        };
+        std::cout << "Latency (us):  p50 " << percentile(0.50)
+                  << "  p90 " << percentile(0.90)
+                  << "  p99 " << percentile(0.99)
+                  << "  max " << latencies.back() << std::endl;
+    }
+
+    return ok ? 0 : -1;
+}
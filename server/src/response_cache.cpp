@@ -0,0 +1,134 @@
+#include <cstring>
+#include <response_cache.hpp>
+
+// Rough per entry bookkeeping (list node, index node) counted against capacity
+static constexpr size_t entry_overhead = 96;
+
+static uint64_t Mix(uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+void ResponseCache::SetCapacity(size_t bytes)
+{
+    _shardCapacity = bytes / shard_count;
+
+    // shrinking applies on the next insert into each shard
+    if (_shardCapacity == 0) {
+        Clear();
+    }
+}
+
+ResponseCache::Key ResponseCache::MakeKey(const char* data, size_t size, bool sealed)
+{
+    // eight bytes per step, the payload is hashed on every cached request
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    }
+
+    // both reply variants of one request get their own entry; Mix is a
+    // bijection, so they never share a hash
+    Key key;
+    key.hash = Mix(hash ^ (sealed ? 1 : 0));
+    key.data = data;
+    key.size = size;
+    key.sealed = sealed;
+    return key;
+}
+
+bool ResponseCache::Lookup(const Key& key, std::vector<char>& frame)
+{
+    Shard& shard = ShardFor(key.hash);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto found = shard.index.find(key.hash);
+    if (found == shard.index.end()) {
+        shard.stats.misses++;
+        return false;
+    }
+
+    // a hash collision is a miss, never someone else's reply
+    Entry& entry = *found->second;
+    if (entry.sealed != key.sealed || entry.key.size() != key.size ||
+        memcmp(entry.key.data(), key.data, key.size) != 0) {
+        shard.stats.misses++;
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    frame.assign(entry.frame.begin(), entry.frame.end());
+    shard.stats.hits++;
+    return true;
+}
+
+void ResponseCache::Insert(const Key& key, const char* frame, size_t size)
+{
+    size_t cost = key.size + size + entry_overhead;
+
+    Shard& shard = ShardFor(key.hash);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    if (cost > _shardCapacity) {
+        return;
+    }
+
+    auto found = shard.index.find(key.hash);
+    if (found != shard.index.end()) {
+        Erase(shard, found->second);
+    }
+
+    while (!shard.lru.empty() && shard.bytes + cost > _shardCapacity) {
+        Erase(shard, std::prev(shard.lru.end()));
+        shard.stats.evictions++;
+    }
+
+    shard.lru.push_front(Entry{ key.hash, key.sealed, std::string(key.data, key.size), std::string(frame, size) });
+    shard.index[key.hash] = shard.lru.begin();
+    shard.bytes += cost;
+}
+
+void ResponseCache::Erase(Shard& shard, std::list<Entry>::iterator it)
+{
+    shard.bytes -= it->key.size() + it->frame.size() + entry_overhead;
+    shard.index.erase(it->hash);
+    shard.lru.erase(it);
+}
+
+void ResponseCache::Clear()
+{
+    for (Shard& shard : _shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
+
+ResponseCache::Stats ResponseCache::stats() const
+{
+    Stats total;
+    for (const Shard& shard : _shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.evictions += shard.stats.evictions;
+        total.entries += shard.lru.size();
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
@@ -1,9 +1,85 @@
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <time.h>
+#include <random>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <sys/un.h>
 #include <constants.hpp>
 #include <server.hpp>
 #include <message.hpp>
+#include <pool.hpp>
+#include <handoff.hpp>
 
-Server::Server(int port) : _socket(0), _connected(false), _currentSize(0)
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// Blobs smaller than this are cheaper to copy than to pin and wait for
+static constexpr size_t zero_copy_threshold = 16384;
+
+// How long a bulk transfer waits for the peer to drain its receive window
+static constexpr int send_timeout_ms = 5000;
+
+static int64_t MonotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// How long a handed off server keeps serving its old connection
+static constexpr int64_t drain_timeout_ns = 30000000000LL;
+
+// Rejections are answered with fixed texts so shedding stays cheap
+static const std::string rate_limited_text = "Rate limit exceeded";
+static const std::string overloaded_text = "Server overloaded";
+
+Server::Server(int port, const std::string& handoffPath, bool takeConnection)
+: _socket(0), _connected(false), _currentSize(0), _serverSocket(-1),
+  _frame(nullptr), _received(0), _frameArrivedNs(0),
+  _checksums(false), _requireChecksums(false), _currentChecksum(false),
+  _zeroCopy(false), _zeroCopySent(0), _zeroCopyDone(0),
+  _cachePending(false),
+  _handoffPath(handoffPath), _handoffSocket(-1),
+  _draining(false), _finished(false), _drainDeadline(0)
+{
+    if (_handoffPath.empty() || !TakeOver(takeConnection)) {
+        Listen(port);
+
+        // datagrams share the port number, the channel stays off if this fails
+        if (_udp.Open(port)) {
+            std::cout << "Datagrams enabled on UDP port: " << port << std::endl;
+        }
+    }
+
+    if (!_handoffPath.empty()) {
+        OpenHandoff();
+    }
+
+    std::cout << "Server Running on port: " << port << std::endl;
+}
+
+Server::~Server()
+{
+    if (_handoffSocket != -1) {
+        close(_handoffSocket);
+        // after a handoff the path belongs to the new process
+        if (!_draining) {
+            unlink(_handoffPath.c_str());
+        }
+    }
+    if (_serverSocket != -1) {
+        close(_serverSocket);
+    }
+}
+
+void Server::Listen(int port)
 {
     // Define the TCP _socket
     _serverSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -20,6 +96,12 @@ Server::Server(int port) : _socket(0), _connected(false), _currentSize(0)
         exit(-1);
     }
 
+    // kernel receive timestamps tell how long frames waited in the queue,
+    // set on the listener so frames that arrive before accept() get them too
+    if (setsockopt(_serverSocket, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(int)) == -1) {
+        std::cerr << "Failed to enable receive timestamps: " << errno << std::endl;
+    }
+
     // get current flags
     int flags = fcntl(_serverSocket, F_GETFL, 0);
     if (flags == -1) {
@@ -49,19 +131,232 @@ Server::Server(int port) : _socket(0), _connected(false), _currentSize(0)
         exit(-1);
     }
 
-    // backlog of 5
-    if (listen(_serverSocket, 5) == -1) {
+    // a full backlog drops connection attempts, and during a hot restart
+    // every reconnecting client lands in it at once
+    if (listen(_serverSocket, SOMAXCONN) == -1) {
         std::cerr << "Failed to listen" << std::endl;
         close(_serverSocket);
         exit(-1);
     }
-    std::cout << "Server Running on port: " << port << std::endl;
 }
 
-Server::~Server() {}
+bool Server::TakeOver(bool takeConnection)
+{
+    int peer = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (peer == -1) {
+        return false;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _handoffPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    // nobody listening means there is no running instance to replace
+    if (connect(peer, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(peer);
+        return false;
+    }
+
+    char state[64];
+    int fds[handoff::max_fds];
+    int count = 0;
+    char request = takeConnection ? handoff::request_connection : handoff::request_listener;
+
+    ssize_t size = -1;
+    if (handoff::SendByte(peer, request)) {
+        size = handoff::ReceiveFds(peer, state, sizeof(state), fds, &count);
+    }
+    if (size <= 0 || count < 1) {
+        std::cerr << "Hot restart handoff failed, binding normally" << std::endl;
+        for (int i = 0; i < count; i++) {
+            close(fds[i]);
+        }
+        close(peer);
+        return false;
+    }
+
+    // state: which descriptors follow the listener, then the UDP session
+    Decoder decoder(state, size);
+    bool hasUdp, hasConnection, hasPeer;
+    int session, peerAddress;
+    short peerPort;
+    decoder.ReadBoolean(&hasUdp);
+    decoder.ReadBoolean(&hasConnection);
+    decoder.ReadBoolean(&hasPeer);
+    decoder.ReadInt(&session);
+    decoder.ReadInt(&peerAddress);
+    decoder.ReadShort(&peerPort);
+    bool checksums;
+    decoder.ReadBoolean(&checksums);
+
+    int next = 0;
+    _serverSocket = fds[next++];
+
+    if (hasUdp && next < count) {
+        _udp.Adopt(fds[next++]);
+    }
+
+    if (hasConnection && next < count) {
+        _socket = fds[next++];
+        _connected = true;
+        _checksums = checksums;
+        _requireChecksums = checksums;
+        _admission.Reset(MonotonicNs());
+
+        sockaddr_in from{};
+        socklen_t fromLen = sizeof(from);
+        getpeername(_socket, (sockaddr*)&from, &fromLen);
+        _tcpStats.Track(_socket, from);
+
+        if (_udp.open()) {
+            _udp.SetSession(session);
+            if (hasPeer) {
+                sockaddr_in from{};
+                from.sin_family = AF_INET;
+                from.sin_addr.s_addr = htonl(peerAddress);
+                from.sin_port = htons(peerPort);
+                _udp.SetPeer(from);
+            }
+        }
+    }
+
+    // the old process stops using its copies once it sees the ack
+    handoff::SendByte(peer, handoff::ack);
+    close(peer);
+
+    std::cout << "Took over listening socket" << (_connected ? " and live connection" : "") << " from running server" << std::endl;
+    return true;
+}
+
+void Server::OpenHandoff()
+{
+    _handoffSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_handoffSocket == -1) {
+        std::cerr << "Failed to create handoff socket: " << errno << std::endl;
+        return;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _handoffPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    // replaces the previous instance's (or a stale) socket file
+    unlink(_handoffPath.c_str());
+    if (bind(_handoffSocket, (sockaddr*)&addr, sizeof(addr)) == -1 || listen(_handoffSocket, 1) == -1) {
+        std::cerr << "Failed to listen for hot restart on " << _handoffPath << ": " << errno << std::endl;
+        close(_handoffSocket);
+        _handoffSocket = -1;
+    }
+}
+
+void Server::PollHandoff()
+{
+    if (_draining) {
+        if (_connected && MonotonicNs() > _drainDeadline) {
+            Disconnect("Drain timeout");
+        }
+        _finished = !_connected;
+        return;
+    }
+
+    if (_handoffSocket == -1) {
+        return;
+    }
+
+    int peer = accept4(_handoffSocket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (peer == -1) {
+        return;
+    }
+
+    HandOff(peer);
+    close(peer);
+}
+
+void Server::HandOff(int peer)
+{
+    // the new process may block on this, so don't leave it hanging
+    fcntl(peer, F_SETFL, fcntl(peer, F_GETFL) & ~O_NONBLOCK);
+
+    char request;
+    if (!handoff::ReceiveByte(peer, &request)) {
+        return;
+    }
+
+    // frames still queued would be lost with our copy of the queue, and so
+    // would the bytes of a half-read frame; mid-frame we keep the connection
+    // and drain it instead
+    bool giveConnection = request == handoff::request_connection && _connected && _currentSize == 0 &&
+        DrainOutbound();
+
+    int fds[handoff::max_fds];
+    int count = 0;
+    fds[count++] = _serverSocket;
+    if (_udp.open()) {
+        fds[count++] = _udp.fd();
+    }
+    if (giveConnection) {
+        fds[count++] = _socket;
+    }
+
+    Encoder state;
+    state.WriteBoolean(_udp.open());
+    state.WriteBoolean(giveConnection);
+    state.WriteBoolean(giveConnection && _udp.hasPeer());
+    state.WriteInt(_udp.session());
+    state.WriteInt(ntohl(_udp.peer().sin_addr.s_addr));
+    state.WriteShort(ntohs(_udp.peer().sin_port));
+    state.WriteBoolean(giveConnection && _checksums);
+
+    // skip the frame length, the payload is the whole message here
+    char ack = 0;
+    if (!handoff::SendFds(peer, state.buffer() + sizeof(int), state.size() - sizeof(int), fds, count) ||
+        !handoff::ReceiveByte(peer, &ack) || ack != handoff::ack) {
+        std::cerr << "Hot restart handoff aborted, still serving" << std::endl;
+        return;
+    }
+
+    // the new process owns the sockets now, only drop our descriptors
+    close(_serverSocket);
+    _serverSocket = -1;
+    if (_udp.open()) {
+        _udp.Close();
+    }
+    if (giveConnection) {
+        _tcpStats.Untrack(_socket);
+        close(_socket);
+        _socket = -1;
+        _connected = false;
+        _currentSize = 0;
+    }
+
+    close(_handoffSocket);
+    _handoffSocket = -1;
+
+    _draining = true;
+    _drainDeadline = MonotonicNs() + drain_timeout_ns;
+    _finished = !_connected;
+    std::cout << "Handed off to new server" << (_connected ? ", draining current connection" : "") << std::endl;
+}
+
+bool Server::StartCapture(const std::string& path)
+{
+    if (!_capture.Open(path)) {
+        return false;
+    }
+
+    // a connection taken over in a hot restart is already mid-session
+    if (_connected) {
+        _capture.MarkConnection();
+    }
+    return true;
+}
 
 void Server::AcceptConnection()
 {
+    if (_serverSocket == -1) {
+        return;
+    }
+
     struct sockaddr_in addr;
     socklen_t addrLen = sizeof(addr);
 
@@ -96,9 +391,68 @@ void Server::AcceptConnection()
     std::cout << "Client Connection Established" << std::endl;
     _connected = true;
     _socket = socket;
+    _checksums = false;
+    _requireChecksums = false;
+    _admission.Reset(MonotonicNs());
+    _tcpStats.Track(socket, addr);
+    _zeroCopy = false;
+    _zeroCopySent = 0;
+    _zeroCopyDone = 0;
+
+    // replay reconnects here, the new session negotiates from scratch
+    _capture.MarkConnection();
+
+    // hand out a session token, the client echoes it over UDP
+    if (_udp.open()) {
+        static std::random_device random;
+        uint32_t session = 0;
+        while (session == 0) {
+            session = random();
+        }
+        _udp.SetSession(session);
+
+        auto message = MessagePool<UdpSessionMessage>::Acquire();
+        message->session = session;
+        Send(*message);
+    }
 }
 
 void Server::HandleConnection()
+{
+    _tcpStats.Poll(MonotonicNs());
+
+    ReceiveDatagrams();
+    ReceiveFrame();
+
+    // replies to both transports go out as one batch per tick, frames that
+    // don't fit the socket buffer wait in their lane for the next one
+    FlushOutbound();
+    _udp.Flush();
+}
+
+void Server::ReceiveDatagrams()
+{
+    _udp.Receive([this](unsigned char packetId, Decoder& decoder, const sockaddr_in& from) {
+        if (packetId == constants::udp_session_id) {
+            // the token matched, so this is where the client's datagrams come from
+            _udp.SetPeer(from);
+
+            auto ack = MessagePool<UdpSessionMessage>::Acquire();
+            decoder.ReadInt(&ack->session);
+            _udp.Queue(*ack);
+            return;
+        }
+
+        // the same buckets as frames; datagrams carry no kernel timestamp
+        // and expect no reply, so a rejected one is just dropped
+        if (_admission.Admit(packetId, -1, MonotonicNs()) != AdmissionControl::Verdict::Admit) {
+            return;
+        }
+        Dispatch(packetId, decoder);
+    });
+}
+
+void Server::ReceiveFrame()
 {
     if (_currentSize == 0)
     {
@@ -108,7 +462,7 @@ void Server::HandleConnection()
         if (result <= 0)
         {
             int err = errno;
-            if (err == EWOULDBLOCK) {
+            if (result < 0 && err == EWOULDBLOCK) {
                 //std::cout << "[DEBUG] No content - non blocking return" << std::endl;
                 return;
             }
@@ -130,19 +484,37 @@ void Server::HandleConnection()
             return;
         }
 
-        _currentSize = ntohl(bytesReadable); // - 4 as thats original size
-        if (_currentSize <= 0 || _currentSize > 8192) {
-            std::string message = "Size under or overflow: " + _currentSize;
+        int length = ntohl(bytesReadable);
+        _currentChecksum = (length & constants::checksum_flag) != 0;
+        _currentSize = length & ~constants::checksum_flag; // - 4 as thats original size
+
+        // the prefix, the id byte and the trailer if there is one
+        int minimumSize = 5 + (_currentChecksum ? sizeof(uint32_t) : 0);
+        if (_currentSize < minimumSize || _currentSize > constants::max_frame_size) {
+            std::string message = "Size under or overflow: " + std::to_string(_currentSize);
             Disconnect(message);
             return;
         }
+
+        // the frame stays in the arena until it is complete and handled
+        _arena.Reset();
+        _frame = static_cast<char*>(_arena.Allocate(_currentSize));
+        _received = 0;
+        _frameArrivedNs = 0;
     }
 
-    std::vector<char> b(_currentSize);
-    int result = recv(_socket, b.data(), _currentSize, 0);
+    iovec iov{ _frame + _received, (size_t)(_currentSize - _received) };
+    char control[CMSG_SPACE(sizeof(timespec))];
+    msghdr header{};
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    int result = recvmsg(_socket, &header, 0);
     if (result <= 0) {
         int err = errno;
-        if (err == EWOULDBLOCK) {
+        if (result < 0 && err == EWOULDBLOCK) {
             return;
         }
 
@@ -158,31 +530,137 @@ void Server::HandleConnection()
         return;
     }
 
-    // + 4 as thats offset to what we already read
-    Decoder decoder(b.data() + 4, _currentSize);
+    // queue latency counts from when the frame's first byte arrived
+    if (_received == 0) {
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&header); cm; cm = CMSG_NXTHDR(&header, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec arrived;
+                memcpy(&arrived, CMSG_DATA(cm), sizeof(timespec));
+                _frameArrivedNs = arrived.tv_sec * 1000000000LL + arrived.tv_nsec;
+            }
+        }
+    }
+
+    // the rest of the frame arrives in a later tick
+    _received += result;
+    if (_received < _currentSize) {
+        return;
+    }
+
+    // frame bytes and handler temporaries are released when this returns
+    Arena::Scope scope(_arena);
+    char* b = _frame;
+
+    // a bad checksum means corruption or a desynced stream, neither of
+    // which can be recovered from; short reads were buffered above, so the
+    // whole frame is checked here
+    if (_currentChecksum) {
+        if (!VerifyChecksum(b, _currentSize)) {
+            Disconnect("Frame checksum mismatch");
+            return;
+        }
+    }
+    else if (_requireChecksums) {
+        Disconnect("Frame without negotiated checksum");
+        return;
+    }
+
+    if (_capture.open()) {
+        _capture.Append(b, _currentSize);
+    }
+
+    // time spent queued in the kernel since the frame's first byte arrived,
+    // unknown (negative) without a kernel timestamp
+    int64_t queueLatency = -1;
+    if (_frameArrivedNs != 0) {
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        queueLatency = now.tv_sec * 1000000000LL + now.tv_nsec - _frameArrivedNs;
+    }
+
+    // reject before decoding anything
+    switch (_admission.Admit(b[4], queueLatency, MonotonicNs()))
+    {
+        case AdmissionControl::Verdict::RateLimited:
+            SendError(rate_limited_text, constants::error_rate_limited);
+            _currentSize = 0;
+            return;
+        case AdmissionControl::Verdict::Overloaded:
+            SendError(overloaded_text, constants::error_overloaded);
+            _currentSize = 0;
+            return;
+        case AdmissionControl::Verdict::Admit:
+            break;
+    }
+
+    // + 4 as thats offset to what we already read, minus the trailer
+    int payloadSize = _currentSize - 4 - (_currentChecksum ? sizeof(uint32_t) : 0);
+    _currentSize = 0;
+
+    // repeated requests are answered with the reply encoded the first time
+    if (_responseCache.enabled(b[4])) {
+        _cacheKey = ResponseCache::MakeKey(b + 4, payloadSize, _checksums);
+        if (_responseCache.Lookup(_cacheKey, _cachedFrame)) {
+            SendFrame(_cachedFrame.data(), _cachedFrame.size());
+            return;
+        }
+        _cachePending = true;
+    }
+
+    Decoder decoder(b + 4, payloadSize);
 
     // Check the first byte (identifier)
     unsigned char packetId;
     decoder.ReadByte(&packetId);
+
+    Dispatch(packetId, decoder);
+    _cachePending = false;
+}
+
+void Server::Dispatch(unsigned char packetId, Decoder& decoder)
+{
     std::cout << "Received message (ID): " << (int)packetId << '\n';
 
     // Handle the packet
     switch ((int)packetId)
     {
         case constants::hello_id: {
-            HelloMessage msg;
-            msg.decode(decoder);
-            int res = msg.addA + msg.addB;
+            auto msg = MessagePool<HelloMessage>::Acquire();
+            msg->decode(decoder);
+            int res = msg->addA + msg->addB;
+
+            std::cout << "Client says:\nText: " << msg->text << "\nAddition of: " << msg->addA << " + " << msg->addB << " which is: " << res << ", therefor solved." << std::endl;
+
+            auto reply = MessagePool<ReplyMessage>::Acquire();
+            reply->text = "This is the server!";
+            reply->result = res;
+            reply->solved = true;
+            reply->test = 123.456f;
+            Send(*reply);
 
-            std::cout << "Client says:\nText: " << msg.text << "\nAddition of: " << msg.addA << " + " << msg.addB << " which is: " << res << ", therefor solved." << std::endl;
+            break;
+        }
+        case constants::integrity_id: {
+            auto msg = MessagePool<IntegrityMessage>::Acquire();
+            msg->decode(decoder);
+
+            // frames are processed in order, so every frame the client sends
+            // after this request carries a trailer
+            _requireChecksums = msg->checksums;
 
-            ReplyMessage reply;
-            reply.text = "This is the server!";
-            reply.result = res;
-            reply.solved = true;
-            reply.test = 123.456f;
-            Send(reply);
+            auto reply = MessagePool<IntegrityMessage>::Acquire();
+            reply->checksums = msg->checksums;
+            Send(*reply);
 
+            _checksums = msg->checksums;
+            std::cout << "Frame checksums " << (_checksums ? "enabled" : "disabled") << std::endl;
+            break;
+        }
+        case constants::state_id: {
+            auto msg = MessagePool<StateMessage>::Acquire();
+            msg->decode(decoder);
+
+            std::cout << "State update for entity " << msg->entity << " (" << msg->values.size() << " values)" << std::endl;
             break;
         }
         default: {
@@ -190,26 +668,54 @@ void Server::HandleConnection()
             break;
         }
     }
-    _currentSize = 0;
 }
 
 void Server::Send(Message& message)
 {
-    Encoder encoder;
-    message.encode(encoder);
+    if (message.delivery() == Delivery::Unreliable && _udp.Queue(message)) {
+        return;
+    }
 
-    const char* buffer = encoder.buffer();
-    int size = encoder.size();
+    _encoder.Reset();
+    message.encode(_encoder);
+    if (_checksums) {
+        _encoder.Seal();
+    }
 
-    int result = send(_socket, buffer, size, 0);
-    if (result <= 0) {
+    // the key still points into the request frame, which outlives Dispatch
+    if (_cachePending) {
+        _responseCache.Insert(_cacheKey, _encoder.buffer(), _encoder.size());
+        _cachePending = false;
+    }
+
+    SendFrame(_encoder.buffer(), _encoder.size());
+}
+
+void Server::SendFrame(const char* buffer, int size)
+{
+    // replies of a handler that outlive its connection have nowhere to go
+    if (!_connected) {
+        return;
+    }
+
+    // written by priority at the end of the tick, see FlushOutbound; a peer
+    // that lets replies pile up past the limit is not reading them
+    if (!_outbound.Push(buffer, size)) {
+        Disconnect("Outbound queue over limit");
+    }
+}
+
+bool Server::FlushOutbound()
+{
+    if (!_connected) {
+        return false;
+    }
+
+    if (_outbound.Flush(_socket) == OutboundQueue::Result::Error) {
         int err = errno;
-        if (err == EWOULDBLOCK) {
-            return;
-        }
 
-        // returning 0 or WSAECONNRESET means closed by host
-        if (result == 0 || err == ECONNRESET) {
+        // EPIPE or WSAECONNRESET means closed by host
+        if (err == EPIPE || err == ECONNRESET) {
             Disconnect("");
         }
         else
@@ -218,9 +724,48 @@ void Server::Send(Message& message)
             std::string m = "FATAL ERROR: send Error: " + std::to_string(err);
             Disconnect(m);
         }
-        return;
+        return false;
+    }
+    return true;
+}
+
+bool Server::DrainOutbound()
+{
+    while (FlushOutbound() && !_outbound.empty()) {
+        if (!WaitWritable()) {
+            return false;
+        }
     }
-    //std::cout << "Sent: " << result << " bytes";
+    return _connected;
+}
+
+void Server::SendError(const std::string& text, short code)
+{
+    auto error = MessagePool<ErrorMessage>::Acquire();
+    error->code = code;
+    error->text = text;
+    Send(*error);
+}
+
+void Server::PrintStats(std::ostream& out) const
+{
+    const AdmissionControl::Stats& admission = _admission.stats();
+    out << "Frames: " << admission.admitted << " admitted, " << admission.rateLimited << " rate limited, "
+        << admission.shed << " shed" << (_admission.shedding() ? " (shedding)" : "") << "\n";
+
+    if (_capture.open()) {
+        out << "Capture: " << _capture.records() << " frames\n";
+    }
+
+    ResponseCache::Stats cache = _responseCache.stats();
+    if (cache.hits + cache.misses > 0) {
+        out << "Response cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+            << cache.evictions << " evictions, " << cache.entries << " entries (" << cache.bytes << " bytes)\n";
+    }
+
+    _outbound.Print(out);
+    _tcpStats.Print(out);
+    out << std::flush;
 }
 
 void Server::Disconnect(const std::string& reason)
@@ -229,12 +774,240 @@ void Server::Disconnect(const std::string& reason)
         return;
     }
 
+    _tcpStats.Untrack(_socket);
+    close(_socket);
     _socket = -1;
     _connected = false;
     _currentSize = 0;
+    _checksums = false;
+    _requireChecksums = false;
+    _outbound.Clear();
+    _udp.SetSession(0);
 
     if (!reason.empty()) {
         std::cout << "Client Disconnected: " << reason << std::endl;
     }
-    close(_socket);
+}
+
+bool Server::SendFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Failed to open " << path << ": " << errno << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        std::cerr << "Failed to stat " << path << ": " << errno << std::endl;
+        close(fd);
+        return false;
+    }
+
+    bool sent = SendFile(fd, 0, st.st_size, path);
+    close(fd);
+    return sent;
+}
+
+bool Server::SendBlobHeader(const std::string& name, int64_t length)
+{
+    // the blob holds the stream until done, so queued frames go first
+    if (!DrainOutbound()) {
+        return false;
+    }
+
+    BlobMessage header;
+    header.name = name;
+    header.length = length;
+
+    Encoder encoder;
+    header.encode(encoder);
+    if (_checksums) {
+        encoder.Seal();
+    }
+    if (!WriteAll(encoder.buffer(), encoder.size())) {
+        return false;
+    }
+    return true;
+}
+
+bool Server::SendFile(int fd, off_t offset, int64_t length, const std::string& name)
+{
+    if (!_connected) {
+        return false;
+    }
+
+    if (!SendBlobHeader(name, length)) {
+        return false;
+    }
+
+    // the kernel moves page cache pages straight into the socket
+    while (length > 0) {
+        ssize_t result = sendfile(_socket, fd, &offset, length);
+        if (result == -1) {
+            int err = errno;
+            if (err == EINTR) {
+                continue;
+            }
+            if (err == EWOULDBLOCK) {
+                if (!WaitWritable()) {
+                    return false;
+                }
+                continue;
+            }
+            Disconnect("FATAL ERROR: sendfile Error: " + std::to_string(err));
+            return false;
+        }
+
+        // the peer already knows the length, a short file desyncs the stream
+        if (result == 0) {
+            Disconnect("File truncated during send: " + name);
+            return false;
+        }
+        length -= result;
+    }
+    return true;
+}
+
+bool Server::SendBlob(const std::string& name, const char* data, size_t length)
+{
+    if (!_connected) {
+        return false;
+    }
+
+    if (!SendBlobHeader(name, length)) {
+        return false;
+    }
+
+    if (length < zero_copy_threshold || !EnableZeroCopy()) {
+        return WriteAll(data, length);
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t result = send(_socket, data + offset, length - offset, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (result == -1) {
+            int err = errno;
+            if (err == EINTR) {
+                continue;
+            }
+            if (err == EWOULDBLOCK) {
+                if (!WaitWritable()) {
+                    return false;
+                }
+                continue;
+            }
+            // out of optmem for pinned pages, copy the rest instead
+            if (err == ENOBUFS) {
+                if (!WriteAll(data + offset, length - offset)) {
+                    return false;
+                }
+                break;
+            }
+            Disconnect("FATAL ERROR: send Error: " + std::to_string(err));
+            return false;
+        }
+        _zeroCopySent++;
+        offset += result;
+    }
+
+    // the caller owns data, so it must stay untouched until the kernel is done
+    return WaitZeroCopy();
+}
+
+bool Server::WriteAll(const char* data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t result = send(_socket, data + offset, size - offset, MSG_NOSIGNAL);
+        if (result == -1) {
+            int err = errno;
+            if (err == EINTR) {
+                continue;
+            }
+            if (err == EWOULDBLOCK) {
+                if (!WaitWritable()) {
+                    return false;
+                }
+                continue;
+            }
+            Disconnect("FATAL ERROR: send Error: " + std::to_string(err));
+            return false;
+        }
+        offset += result;
+    }
+    return true;
+}
+
+bool Server::WaitWritable()
+{
+    pollfd pfd{};
+    pfd.fd = _socket;
+    pfd.events = POLLOUT;
+
+    int result = poll(&pfd, 1, send_timeout_ms);
+    if (result <= 0 || (pfd.revents & (POLLERR | POLLHUP))) {
+        Disconnect(result == 0 ? "Send timed out" : "Connection lost during send");
+        return false;
+    }
+    return true;
+}
+
+bool Server::EnableZeroCopy()
+{
+    if (_zeroCopy) {
+        return true;
+    }
+
+    int yes = 1;
+    if (setsockopt(_socket, SOL_SOCKET, SO_ZEROCOPY, &yes, sizeof(int)) == -1) {
+        return false;
+    }
+    _zeroCopy = true;
+    return true;
+}
+
+bool Server::WaitZeroCopy()
+{
+    // completions arrive on the error queue as ranges of send call ids
+    while (_connected && _zeroCopyDone != _zeroCopySent) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(_socket, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EWOULDBLOCK) {
+                Disconnect("FATAL ERROR: zerocopy completion Error: " + std::to_string(errno));
+                return false;
+            }
+
+            pollfd pfd{};
+            pfd.fd = _socket;
+            pfd.events = 0; // POLLERR is always reported
+            if (poll(&pfd, 1, send_timeout_ms) <= 0) {
+                Disconnect("Zerocopy completion timed out");
+                return false;
+            }
+            continue;
+        }
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+
+            auto* err = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // ee_data is the highest id in this completed range
+            _zeroCopyDone = err->ee_data + 1;
+        }
+    }
+    return _connected;
 }
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <tcp_stats.hpp>
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <arpa/inet.h>
+
+void TcpSampler::Track(int fd, const sockaddr_in& peer)
+{
+    // reuse the oldest closed slot once the table is full
+    TcpConnectionStats* slot = nullptr;
+    if (_connections.size() < max_connections) {
+        slot = &_connections.emplace_back();
+    }
+    else {
+        auto closed = std::find_if(_connections.begin(), _connections.end(),
+            [](const TcpConnectionStats& stats) { return stats.fd == -1; });
+        if (closed == _connections.end()) {
+            return;
+        }
+        // keep the table in tracking order so the front is always the oldest
+        std::rotate(closed, closed + 1, _connections.end());
+        slot = &_connections.back();
+    }
+
+    *slot = TcpConnectionStats{};
+    slot->peer = peer;
+    slot->fd = fd;
+    Record(*slot);
+}
+
+void TcpSampler::Untrack(int fd)
+{
+    for (TcpConnectionStats& stats : _connections) {
+        if (stats.fd == fd) {
+            Record(stats);
+            stats.fd = -1;
+        }
+    }
+}
+
+void TcpSampler::Poll(int64_t nowNs)
+{
+    if (nowNs - _lastPoll < _intervalNs) {
+        return;
+    }
+    _lastPoll = nowNs;
+
+    for (TcpConnectionStats& stats : _connections) {
+        if (stats.fd != -1) {
+            Record(stats);
+        }
+    }
+}
+
+bool TcpSampler::Sample(int fd, TcpSample* sample)
+{
+    tcp_info info{};
+    socklen_t length = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == -1) {
+        return false;
+    }
+
+    sample->rttUs = info.tcpi_rtt;
+    sample->rttVarUs = info.tcpi_rttvar;
+    sample->retransmits = info.tcpi_total_retrans;
+    sample->cwnd = info.tcpi_snd_cwnd;
+    sample->unacked = info.tcpi_unacked;
+
+    int queued = 0;
+    sample->sendQueue = ioctl(fd, SIOCOUTQ, &queued) == 0 ? queued : 0;
+    queued = 0;
+    sample->receiveQueue = ioctl(fd, SIOCINQ, &queued) == 0 ? queued : 0;
+    return true;
+}
+
+void TcpSampler::Record(TcpConnectionStats& stats)
+{
+    TcpSample sample;
+    if (!Sample(stats.fd, &sample)) {
+        return;
+    }
+
+    stats.last = sample;
+    stats.samples++;
+    stats.rttSumUs += sample.rttUs;
+    stats.maxRttUs = std::max(stats.maxRttUs, sample.rttUs);
+    stats.maxSendQueue = std::max(stats.maxSendQueue, sample.sendQueue);
+}
+
+TcpSampler::Aggregate TcpSampler::aggregate() const
+{
+    Aggregate result;
+    uint64_t rttSum = 0;
+
+    for (const TcpConnectionStats& stats : _connections) {
+        if (stats.fd == -1) {
+            continue;
+        }
+        result.open++;
+        rttSum += stats.last.rttUs;
+        result.maxRttUs = std::max(result.maxRttUs, stats.last.rttUs);
+        result.retransmits += stats.last.retransmits;
+        result.sendQueue += stats.last.sendQueue;
+        result.receiveQueue += stats.last.receiveQueue;
+    }
+
+    if (result.open > 0) {
+        result.avgRttUs = rttSum / result.open;
+    }
+    return result;
+}
+
+std::vector<const TcpConnectionStats*> TcpSampler::WorstBySendQueue(size_t count) const
+{
+    std::vector<const TcpConnectionStats*> worst;
+    for (const TcpConnectionStats& stats : _connections) {
+        worst.push_back(&stats);
+    }
+
+    count = std::min(count, worst.size());
+    std::partial_sort(worst.begin(), worst.begin() + count, worst.end(),
+        [](const TcpConnectionStats* a, const TcpConnectionStats* b) {
+            return std::max(a->last.sendQueue, a->maxSendQueue) > std::max(b->last.sendQueue, b->maxSendQueue);
+        });
+    worst.resize(count);
+    return worst;
+}
+
+std::vector<const TcpConnectionStats*> TcpSampler::WorstByRtt(size_t count) const
+{
+    std::vector<const TcpConnectionStats*> worst;
+    for (const TcpConnectionStats& stats : _connections) {
+        worst.push_back(&stats);
+    }
+
+    count = std::min(count, worst.size());
+    std::partial_sort(worst.begin(), worst.begin() + count, worst.end(),
+        [](const TcpConnectionStats* a, const TcpConnectionStats* b) { return a->maxRttUs > b->maxRttUs; });
+    worst.resize(count);
+    return worst;
+}
+
+static void PrintConnection(std::ostream& out, const TcpConnectionStats& stats)
+{
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &stats.peer.sin_addr, address, sizeof(address));
+
+    out << "  " << address << ":" << ntohs(stats.peer.sin_port)
+        << (stats.fd == -1 ? " (closed)" : "")
+        << " rtt " << stats.last.rttUs << "us"
+        << " (avg " << (stats.samples ? stats.rttSumUs / stats.samples : 0)
+        << ", max " << stats.maxRttUs << ")"
+        << " retrans " << stats.last.retransmits
+        << " cwnd " << stats.last.cwnd
+        << " unacked " << stats.last.unacked
+        << " sendq " << stats.last.sendQueue << " (max " << stats.maxSendQueue << ")"
+        << " recvq " << stats.last.receiveQueue << "\n";
+}
+
+void TcpSampler::Print(std::ostream& out, size_t worst) const
+{
+    Aggregate total = aggregate();
+    out << "TCP: " << total.open << " open, rtt avg " << total.avgRttUs << "us max " << total.maxRttUs
+        << "us, retrans " << total.retransmits
+        << ", sendq " << total.sendQueue << " bytes, recvq " << total.receiveQueue << " bytes\n";
+
+    out << "Worst by send queue:\n";
+    for (const TcpConnectionStats* stats : WorstBySendQueue(worst)) {
+        PrintConnection(out, *stats);
+    }
+
+    out << "Worst by rtt:\n";
+    for (const TcpConnectionStats* stats : WorstByRtt(worst)) {
+        PrintConnection(out, *stats);
+    }
+}